@@ -0,0 +1,37 @@
+# gen_predefined.cmake --- generates predefined.h from predefined.txt
+#    ex) cmake -DINPUT=predefined.txt -DOUTPUT=predefined.h -P gen_predefined.cmake
+##############################################################################
+
+file(STRINGS "${INPUT}" names)
+
+set(text "/* automatically generated from predefined.txt */\n")
+set(text "${text}#define STRINGIFY(x) #x\n")
+set(text "${text}#define XSTRINGIFY(x) STRINGIFY(x)\n")
+set(text "${text}\n")
+set(text "${text}/* a macro of the host compiler */\n")
+set(text "${text}struct PREDEFINED_MACRO\n{\n")
+set(text "${text}    const char *name;\n")
+set(text "${text}    const char *params;     /* NULL if object-like */\n")
+set(text "${text}    const char *value;\n")
+set(text "${text}};\n")
+set(text "${text}\n")
+set(text "${text}static const PREDEFINED_MACRO s_predefined_macros[] =\n{\n")
+
+foreach(name ${names})
+    string(REGEX REPLACE "[ \t\r]" "" name "${name}")
+    if (name MATCHES "^([A-Za-z0-9_]+)\\((.*)\\)$")
+        # function-like, e.g. __INT64_C(c)
+        set(text "${text}#ifdef ${CMAKE_MATCH_1}\n")
+        set(text "${text}    { \"${CMAKE_MATCH_1}\", \"${CMAKE_MATCH_2}\", XSTRINGIFY(${name}) },\n")
+        set(text "${text}#endif\n")
+    elseif (name)
+        set(text "${text}#ifdef ${name}\n")
+        set(text "${text}    { \"${name}\", 0, XSTRINGIFY(${name}) },\n")
+        set(text "${text}#endif\n")
+    endif()
+endforeach()
+
+set(text "${text}    { 0, 0, 0 }\n")
+set(text "${text}};\n")
+
+file(WRITE "${OUTPUT}" "${text}")
@@ -5,12 +5,58 @@
 #include <boost/wave.hpp>
 #include <boost/wave/cpplexer/cpp_lex_token.hpp>
 #include <boost/wave/cpplexer/cpp_lex_iterator.hpp>
+#include <boost/wave/cpplexer/re2clex/cpp_re2c_lexer.hpp>
+#include <boost/wave/grammars/cpp_grammar.hpp>
+#include <boost/wave/grammars/cpp_chlit_grammar.hpp>
+#include <boost/wave/grammars/cpp_defined_grammar.hpp>
+#include <boost/wave/grammars/cpp_expression_grammar.hpp>
+#include <boost/wave/grammars/cpp_has_include_grammar.hpp>
+#include <boost/wave/grammars/cpp_intlit_grammar.hpp>
+#include <boost/wave/grammars/cpp_predef_macros_grammar.hpp>
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 #ifdef _WIN32
     #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <signal.h>
+    #include <errno.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/resource.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #define MZCPP_SSE2
 #endif
 
 void show_version(void)
@@ -22,6 +68,8 @@ void show_help(void)
 {
     std::cout <<
         "Usage: cpp [options] input-file.h\n"
+        "       cpp [options] --batch list.txt\n"
+        "       cpp [options] input-file-1.h input-file-2.h ...\n"
         "Options:\n"
         "  -Dmacro           Defines a macro\n"
         "  -Dmacro=def       Defines a macro\n"
@@ -32,7 +80,57 @@ void show_help(void)
         "  -x language       Sets language ('c', 'c++' or 'rc')\n"
         "  -dM               Prints macro definitions\n"
         "  -oM macros.txt    Sets macro output file\n"
-        "  -E                Ignored" << std::endl;
+        "  --macros-only     Prints macro definitions only, processing the\n"
+        "                    directives without expanding the text\n"
+        "  -M                Prints the dependencies of the input only, processing\n"
+        "                    the directives without expanding the text\n"
+        "  -MD               Writes the dependencies besides the output\n"
+        "  -MF deps.d        Sets dependency output file\n"
+        "  -MT target        Sets the target of the dependencies\n"
+        "  --batch list.txt  Preprocesses each 'input [output [macro-output]]' line\n"
+        "  -j jobs           Preprocesses multiple files in parallel (0: all cores)\n"
+        "  --server socket   Serves requests of clients on a local socket, only\n"
+        "                    for the user (put it in a private directory)\n"
+        "  --client socket   Forwards the other options to the server\n"
+        "  --snapshot-save snapshot.bin\n"
+        "                    Saves the macros and include guards after the input\n"
+        "  --snapshot snapshot.bin\n"
+        "                    Starts from a saved snapshot, as if its input were\n"
+        "                    included first (ignored if out of date)\n"
+        "  --include-db includes.db\n"
+        "                    Keeps the include guards and the include paths\n"
+        "                    found between runs, to open fewer headers\n"
+        "  --cache dir       Reuses the outputs of the previous runs with the same\n"
+        "                    input, options and included files\n"
+        "  --cache-size size Limits the size of the cache (default: 256M)\n"
+        "  --cache-stats     Prints the statistics of the cache\n"
+        "  --cache-clear     Removes the outputs in the cache\n"
+        "  --incremental state.bin\n"
+        "                    Resumes from the last #include of the input before\n"
+        "                    the first file changed since the previous run\n"
+        "  --output-thread   Writes the output on a separate thread\n"
+        "  --no-expansion-cache\n"
+        "                    Expands the object-like macros again every time\n"
+        "  --stats           Prints statistics to stderr\n"
+        "  --time-report     Prints the time of each phase, the counts and the\n"
+        "                    peak memory to stderr\n"
+        "  --time-report-json report.json\n"
+        "                    Writes the time report as JSON ('-' for stderr)\n"
+        "  --macro-profile profile.txt\n"
+        "                    Writes the count, the total and self time and the\n"
+        "                    tokens generated of each macro expanded\n"
+        "  --macro-stacks stacks.folded\n"
+        "                    Writes the time of the stacks of nested expansions,\n"
+        "                    in the folded format of the flame graph tools\n"
+        "  --include-graph graph.json\n"
+        "                    Writes the include graph as JSON, with the time,\n"
+        "                    the bytes and the tokens of each file and the\n"
+        "                    times it was included or skipped by its guard\n"
+        "  --include-graph-dot graph.dot\n"
+        "                    Writes the include graph for Graphviz\n"
+        "  -E                Ignored\n"
+        "If the environment variable MZCPP_SERVER is set to the socket of a\n"
+        "server, the options are forwarded to it when it is running." << std::endl;
 }
 
 enum EXITCODE
@@ -44,367 +142,7556 @@ enum EXITCODE
     EXITCODE_FAILPROCESS
 };
 
+typedef unsigned long long hash_type;
+static const hash_type HASH_SEED = 14695981039346656037ULL;
 
-template <typename T_CONTEXT>
-bool setup_context(T_CONTEXT& context, int argc, char **argv,
-                   const std::string& language)
+// Hashes bytes by 64-bit FNV-1a. Pass the previous hash to continue it.
+hash_type hash_bytes(const void *data, size_t size, hash_type hash = HASH_SEED)
 {
-    using namespace boost;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 
-    if (language == "c++")
+hash_type hash_string(const std::string& str, hash_type hash = HASH_SEED)
+{
+    // The terminator separates the strings
+    return hash_bytes(str.c_str(), str.size() + 1, hash);
+}
+
+// BinaryWriter --- writes integers (little endian) and strings into a buffer
+class BinaryWriter
+{
+public:
+    void put_u8(unsigned char value)
     {
-        context.set_language(
-            wave::language_support(
-#if __cplusplus >= 201103L
-                wave::support_cpp11 |
-#else
-                wave::support_cpp |
-#endif
-                wave::support_option_variadics |
-                wave::support_option_long_long |
-                wave::support_option_emit_contnewlines |
-                wave::support_option_insert_whitespace |
-                wave::support_option_no_character_validation |
-                wave::support_option_convert_trigraphs |
-                wave::support_option_single_line |
-                wave::support_option_emit_line_directives |
-                wave::support_option_include_guard_detection |
-                wave::support_option_emit_pragma_directives));
+        m_data += char(value);
     }
-    else
+    void put_u32(unsigned int value)
     {
-        context.set_language(
-            wave::language_support(
-                wave::support_c99 |
-                wave::support_option_variadics |
-                wave::support_option_long_long |
-                wave::support_option_emit_contnewlines |
-                wave::support_option_insert_whitespace |
-                wave::support_option_no_character_validation |
-                wave::support_option_convert_trigraphs |
-                wave::support_option_single_line |
-                wave::support_option_emit_line_directives |
-                wave::support_option_include_guard_detection |
-                wave::support_option_emit_pragma_directives));
+        for (int i = 0; i < 4; ++i)
+            m_data += char((value >> (i * 8)) & 0xFF);
+    }
+    void put_u64(unsigned long long value)
+    {
+        for (int i = 0; i < 8; ++i)
+            m_data += char((value >> (i * 8)) & 0xFF);
+    }
+    template <typename T_STRING>
+    void put_string(const T_STRING& str)
+    {
+        put_u32((unsigned int)str.size());
+        m_data.append(str.c_str(), str.size());
     }
 
-    if (language == "rc")
+    const std::string& data() const
     {
-        context.add_macro_definition("RC_INVOKED=1", true);
+        return m_data;
     }
 
-    add_predefined_macros(context);
+protected:
+    std::string m_data;
+};
 
-    for (int i = 1; i < argc; ++i)
+// BinaryReader --- reads the data of BinaryWriter.
+// A read beyond the end fails and fails all the following reads.
+class BinaryReader
+{
+public:
+    BinaryReader(const char *first, const char *last)
+        : m_ptr(first), m_last(last)
     {
-        if (argv[i][0] == '-')
-        {
-            std::string str = argv[i];
-            if (str == "-dM")
-                continue;
-            if (str == "-o" || str == "-oM" || str == "-x")
-            {
-                ++i;
-                continue;
-            }
-
-            switch (argv[i][1])
-            {
-            case 'D':
-                context.add_macro_definition(str.substr(2));
-                break;
-            case 'U':
-                context.remove_macro_definition(str.substr(2));
-                break;
-            case 'I':
-                context.add_include_path(&(argv[i][2]));
-                break;
-            case 'S':
-                context.add_sysinclude_path(&(argv[i][2]));
-                break;
-            case 'E':
-                // ignored
-                break;
-            default:
-                std::cerr << "ERROR: invalid argument '" << str << "'\n";
-                return false;
-            }
-        }
     }
 
-#ifdef _WIN32
-    const int MAX_ENV = 512;
-    #if defined(_MSC_VER) || defined(__BORLANDC__)
-        char szInclude[MAX_ENV];
-        if (GetEnvironmentVariableA("INCLUDE", szInclude, MAX_ENV))
-        {
-            context.add_sysinclude_path(szInclude);
-        }
-    #elif defined(__MINGW32__) || defined(__CYGWIN__) || defined(__clang__)
-        char szInclude[MAX_ENV], szHost[MAX_ENV];
-        if (GetEnvironmentVariableA("MINGW_PREFIX", szInclude, MAX_ENV))
-        {
-            strcat(szInclude, "/include");
-            context.add_sysinclude_path(szInclude);
-        }
-        if (GetEnvironmentVariableA("MINGW_PREFIX", szInclude, MAX_ENV) &&
-            GetEnvironmentVariableA("MINGW_CHOST", szHost, MAX_ENV))
-        {
-            strcat(szInclude, "/");
-            strcat(szInclude, szHost);
-            strcat(szInclude, "/include");
-            context.add_sysinclude_path(szInclude);
-        }
-    #endif
-#else   // ndef _WIN32
-    const char *path1 = getenv("CPATH"), path2 = NULL, path3 = NULL;
-    if (path1)
+    bool get_u8(unsigned char& value)
     {
-        context.add_sysinclude_path(path1);
+        if (m_last - m_ptr < 1)
+            return fail();
+        value = (unsigned char)*m_ptr++;
+        return true;
     }
-    if (language == "c" || language == "rc")
+    bool get_u32(unsigned int& value)
     {
-        path2 = getenv("C_INCLUDE_PATH");
-        if (path2)
-        {
-            context.add_sysinclude_path(path2);
-        }
+        unsigned long long value64;
+        if (!get_bytes(value64, 4))
+            return false;
+        value = (unsigned int)value64;
+        return true;
     }
-    else if (language == "c++")
+    bool get_u64(unsigned long long& value)
     {
-        path3 = getenv("CPLUS_INCLUDE_PATH");
-        if (path3)
-        {
-            context.add_sysinclude_path(path3);
-        }
+        return get_bytes(value, 8);
     }
-    if (!path1 && !path2 && !path3)
+    template <typename T_STRING>
+    bool get_string(T_STRING& str)
     {
-        context.add_sysinclude_path("/usr/include");
+        unsigned int size;
+        if (!get_u32(size) || size_t(m_last - m_ptr) < size)
+            return fail();
+        str = T_STRING(m_ptr, m_ptr + size);
+        m_ptr += size;
+        return true;
     }
-#endif  // ndef _WIN32
 
-    return true;
-}
+    bool at_end() const
+    {
+        return m_ptr == m_last;
+    }
 
-class MyInputPolicy
+protected:
+    const char *m_ptr;
+    const char *m_last;
+
+    bool fail()
+    {
+        m_ptr = m_last = NULL;
+        return false;
+    }
+
+    bool get_bytes(unsigned long long& value, int count)
+    {
+        if (m_last - m_ptr < count)
+            return fail();
+        value = 0;
+        for (int i = 0; i < count; ++i)
+            value |= (unsigned long long)(unsigned char)m_ptr[i] << (i * 8);
+        m_ptr += count;
+        return true;
+    }
+};
+
+
+// MacroSnapshot --- a copy of the macro definitions of a context.
+// Restoring it is much cheaper than parsing the definitions again.
+// It can also hold the include guards and the output of a prefix header,
+// and be written to a file (see save_snapshot_file).
+template <typename T_CONTEXT>
+class MacroSnapshot
 {
 public:
-    template <typename CONTEXT_IT_T>
-    class inner
+    typedef typename T_CONTEXT::token_type token_type;
+    typedef typename T_CONTEXT::string_type string_type;
+    typedef typename T_CONTEXT::position_type position_type;
+    typedef typename T_CONTEXT::token_sequence_type token_sequence_type;
+    typedef std::vector<std::pair<std::string, std::string> > guards_type;
+
+    void save(T_CONTEXT& context)
     {
-    public:
-        static std::string readFile(const char* filePath)
+        m_macros.clear();
+
+        typename T_CONTEXT::name_iterator it, end = context.macro_names_end();
+        for (it = context.macro_names_begin(); it != end; ++it)
         {
-            // Open file
-            std::ifstream fs(filePath);
-            if (!fs)
+            MACRO macro;
+            macro.name = *it;
+            if (context.get_macro_definition(*it, macro.is_function,
+                                             macro.is_predef, macro.pos,
+                                             macro.params, macro.tokens))
             {
-                std::string msg = "Cannot open file '";
-                msg += (filePath == NULL) ? "(null)" : filePath;
-                msg += "'.";
-                throw std::runtime_error(msg.c_str());
+                m_macros.push_back(macro);
             }
+        }
 
-            // Read
-            fs.unsetf(std::ios::skipws);
-            std::string text(
-                std::istreambuf_iterator<char>(fs.rdbuf()),
-                std::istreambuf_iterator<char>());
+        m_guards = context.get_hooks().guards();
+        m_predefined_considered = context.get_hooks().predefined_considered();
+    }
 
-            return text;
-        }
+    // Saves the macros of the names only, as the changes since an earlier
+    // snapshot. The names not defined are returned as removed.
+    void save(T_CONTEXT& context, const std::set<std::string>& names,
+              std::vector<std::string>& removed)
+    {
+        m_macros.clear();
+        removed.clear();
 
-        template<typename PositionT>
-        static void init_iterators(
-            CONTEXT_IT_T& context_it,
-            const PositionT& pos,
-            boost::wave::language_support language)
+        std::set<std::string>::const_iterator it, end = names.end();
+        for (it = names.begin(); it != end; ++it)
         {
-            try
+            MACRO macro;
+            macro.name = it->c_str();
+            if (context.get_macro_definition(macro.name, macro.is_function,
+                                             macro.is_predef, macro.pos,
+                                             macro.params, macro.tokens))
             {
-                context_it.code = readFile(context_it.filename.c_str());
-                context_it.code += '\n';    // avoid errors
+                m_macros.push_back(macro);
             }
-            catch (const std::exception&)
+            else
             {
-                BOOST_WAVE_THROW_CTX(
-                    context_it.ctx,
-                    boost::wave::preprocess_exception,
-                    bad_include_file,
-                    context_it.filename.c_str(),
-                    pos);
-                return;
+                removed.push_back(*it);
             }
-
-            typedef typename CONTEXT_IT_T::iterator_type iterator_type;
-            context_it.first =
-                iterator_type(
-                    context_it.code.begin(),
-                    context_it.code.end(),
-                    PositionT(context_it.filename),
-                    language);
-            context_it.last = iterator_type();
         }
 
-    protected:
-        std::string code;
-    };
-};
-
-typedef boost::wave::cpplexer::lex_token<> token_type;
-typedef boost::wave::cpplexer::lex_iterator<token_type> TokenIterator;
-typedef boost::wave::context<std::string::const_iterator, TokenIterator, MyInputPolicy> WaveContext;
-
-std::string get_position_str(const typename token_type::position_type& pos)
-{
-    std::stringstream ss;
-    ss << pos.get_file();
-    ss << ':';
-    ss << pos.get_line();
-    //ss << ':';
-    //ss << pos.get_column();
-    std::string str = ss.str();
-    for (size_t i = 0; i < str.size(); ++i)
-    {
-        if (str[i] == '\\')
-            str[i] = '/';
+        m_guards = context.get_hooks().guards();
+        m_predefined_considered = context.get_hooks().predefined_considered();
     }
-    return str;
-}
-
-template <class CharT, class Traits>
-void print_definitions(WaveContext& context, std::basic_ostream<CharT, Traits>& out)
-{
-    bool is_function, is_predef;
-    WaveContext::position_type pos;
-    std::vector<token_type> params;
-    WaveContext::token_sequence_type tokens;
 
-    WaveContext::name_iterator it, end = context.macro_names_end();
-    for (it = context.macro_names_begin(); it != end; ++it)
+    // Applies the changes saved by the other snapshot
+    void apply(const MacroSnapshot& changes, const std::vector<std::string>& removed)
     {
-        if (!context.get_macro_definition(*it, is_function, is_predef, pos,
-                                          params, tokens) || is_predef)
+        std::set<string_type> names;
+        for (size_t i = 0; i < removed.size(); ++i)
+            names.insert(string_type(removed[i].c_str()));
+        for (size_t i = 0; i < changes.m_macros.size(); ++i)
+            names.insert(changes.m_macros[i].name);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < m_macros.size(); ++i)
         {
-            continue;
+            if (names.find(m_macros[i].name) == names.end())
+                std::swap(m_macros[kept++], m_macros[i]);
         }
+        m_macros.resize(kept);
+        m_macros.insert(m_macros.end(), changes.m_macros.begin(), changes.m_macros.end());
+
+        m_guards = changes.m_guards;
+        m_predefined_considered = changes.m_predefined_considered;
+    }
 
-        out << get_position_str(pos) << ": #define " << *it;
-        if (is_function)
+    // The macros built into Wave are already defined by set_language
+    void restore(T_CONTEXT& context) const
+    {
+        typename std::vector<MACRO>::const_iterator it, end = m_macros.end();
+        for (it = m_macros.begin(); it != end; ++it)
         {
-            out << "(";
-            std::vector<WaveContext::token_type>::iterator it, end = params.end();
-            it = params.begin();
-            if (it != end)
-            {
-                out << it->get_value();
-                ++it;
-                for (; it != end; ++it)
-                {
-                    out << "," << it->get_value();
-                }
-            }
-            out << ")";
+            if (context.is_defined_macro(it->name))
+                continue;
+
+            std::vector<token_type> params = it->params;
+            token_sequence_type tokens = it->tokens;
+            context.add_macro_definition(it->name, it->pos, it->is_function,
+                                         params, tokens, it->is_predef);
         }
-        out << " ";
+
+        // The guarded headers are not opened again
+        for (size_t i = 0; i < m_guards.size(); ++i)
         {
-            WaveContext::token_sequence_type::iterator it, end = tokens.end();
-            for (it = tokens.begin(); it != end; ++it)
-            {
-                out << it->get_value();
-            }
+            context.get_hooks().add_known_guard(context, m_guards[i].first,
+                                                m_guards[i].second);
         }
-        out << "\n";
+
+        context.get_hooks().predefined_considered() = m_predefined_considered;
     }
-}
 
-int main(int argc, char **argv)
-{
-    if (argc < 2)
+    size_t size() const
     {
-        show_help();
-        return EXITCODE_INVALIDARG;
+        return m_macros.size();
     }
 
-    std::string arg1 = argv[1];
-    if (arg1 == "--help")
+    void add_guard(const std::string& file, const std::string& guard)
     {
-        show_help();
-        return EXITCODE_SUCCESS;
+        m_guards.push_back(std::make_pair(file, guard));
     }
-    if (arg1 == "--version")
+
+    // The output of the prefix header, to be emitted before the input
+    const std::string& output() const
     {
-        show_version();
-        return EXITCODE_SUCCESS;
+        return m_output;
+    }
+    void set_output(const std::string& output)
+    {
+        m_output = output;
     }
 
-    std::string input_file, output_file, macro_output_file, language;
-    bool emit_definitions = false;
-    for (int i = 1; i < argc; ++i)
+    void write(BinaryWriter& writer) const
     {
-        std::string arg = argv[i];
-        if (arg[0] != '-')
+        std::map<std::string, unsigned int> files;
+
+        writer.put_u32((unsigned int)m_macros.size());
+        typename std::vector<MACRO>::const_iterator it, end = m_macros.end();
+        for (it = m_macros.begin(); it != end; ++it)
         {
-            if (input_file.empty())
-            {
-                input_file = arg;
-            }
-            else
-            {
-                std::cerr << "ERROR: multiple input files specified\n";
-                return EXITCODE_INVALIDARG;
-            }
+            writer.put_string(it->name);
+            writer.put_u8((it->is_function ? 1 : 0) | (it->is_predef ? 2 : 0));
+            write_position(writer, files, it->pos);
+
+            writer.put_u32((unsigned int)it->params.size());
+            for (size_t i = 0; i < it->params.size(); ++i)
+                write_token(writer, files, it->params[i]);
+
+            writer.put_u32((unsigned int)it->tokens.size());
+            typename token_sequence_type::const_iterator tok;
+            for (tok = it->tokens.begin(); tok != it->tokens.end(); ++tok)
+                write_token(writer, files, *tok);
         }
-        else if (arg == "-o")
+
+        writer.put_u32((unsigned int)m_guards.size());
+        for (size_t i = 0; i < m_guards.size(); ++i)
         {
-            if (i + 1 < argc)
-            {
-                output_file = argv[i + 1];
-                ++i;
-            }
-            else
-            {
-                std::cerr << "ERROR: No argument specified for '-o'\n";
-                return EXITCODE_INVALIDARG;
-            }
+            writer.put_string(m_guards[i].first);
+            writer.put_string(m_guards[i].second);
         }
-        else if (arg == "-oM")
+
+        writer.put_u32((unsigned int)m_predefined_considered.size());
+        for (size_t i = 0; i < m_predefined_considered.size(); ++i)
+            writer.put_u8(m_predefined_considered[i]);
+
+        writer.put_string(m_output);
+    }
+
+    bool read(BinaryReader& reader)
+    {
+        std::vector<string_type> files;
+
+        m_macros.clear();
+        m_guards.clear();
+
+        unsigned int count, num_tokens;
+        unsigned char flags;
+        if (!reader.get_u32(count))
+            return false;
+        for (unsigned int k = 0; k < count; ++k)
         {
-            if (i + 1 < argc)
+            MACRO macro;
+            if (!reader.get_string(macro.name) || !reader.get_u8(flags) ||
+                !read_position(reader, files, macro.pos) ||
+                !reader.get_u32(num_tokens))
             {
-                macro_output_file = argv[i + 1];
-                ++i;
+                return false;
             }
-            else
+            macro.is_function = (flags & 1) != 0;
+            macro.is_predef = (flags & 2) != 0;
+
+            for (unsigned int i = 0; i < num_tokens; ++i)
             {
-                std::cerr << "ERROR: No argument specified for '-oM'\n";
-                return EXITCODE_INVALIDARG;
+                token_type token;
+                if (!read_token(reader, files, token))
+                    return false;
+                macro.params.push_back(token);
             }
-        }
-        else if (arg == "-x")
-        {
-            if (i + 1 < argc)
+
+            if (!reader.get_u32(num_tokens))
+                return false;
+            for (unsigned int i = 0; i < num_tokens; ++i)
+            {
+                token_type token;
+                if (!read_token(reader, files, token))
+                    return false;
+                macro.tokens.push_back(token);
+            }
+
+            m_macros.push_back(macro);
+        }
+
+        if (!reader.get_u32(count))
+            return false;
+        for (unsigned int k = 0; k < count; ++k)
+        {
+            std::pair<std::string, std::string> guard;
+            if (!reader.get_string(guard.first) || !reader.get_string(guard.second))
+                return false;
+            m_guards.push_back(guard);
+        }
+
+        if (!reader.get_u32(count))
+            return false;
+        m_predefined_considered.assign(count, false);
+        for (unsigned int k = 0; k < count; ++k)
+        {
+            if (!reader.get_u8(flags))
+                return false;
+            m_predefined_considered[k] = (flags != 0);
+        }
+
+        return reader.get_string(m_output);
+    }
+
+protected:
+    struct MACRO
+    {
+        string_type name;
+        bool is_function;
+        bool is_predef;
+        position_type pos;
+        std::vector<token_type> params;
+        token_sequence_type tokens;
+    };
+    std::vector<MACRO> m_macros;
+    guards_type m_guards;
+    std::vector<bool> m_predefined_considered;
+    std::string m_output;
+
+    // A file name is written at its first use only
+    static void write_position(BinaryWriter& writer,
+                               std::map<std::string, unsigned int>& files,
+                               const position_type& pos)
+    {
+        std::string file = pos.get_file().c_str();
+        std::map<std::string, unsigned int>::iterator it = files.find(file);
+        if (it == files.end())
+        {
+            unsigned int index = (unsigned int)files.size();
+            files[file] = index;
+            writer.put_u32(index);
+            writer.put_string(file);
+        }
+        else
+        {
+            writer.put_u32(it->second);
+        }
+        writer.put_u32((unsigned int)pos.get_line());
+        writer.put_u32((unsigned int)pos.get_column());
+    }
+
+    static bool read_position(BinaryReader& reader,
+                              std::vector<string_type>& files,
+                              position_type& pos)
+    {
+        unsigned int index, line, column;
+        if (!reader.get_u32(index) || index > files.size())
+            return false;
+        if (index == files.size())
+        {
+            string_type file;
+            if (!reader.get_string(file))
+                return false;
+            files.push_back(file);
+        }
+        if (!reader.get_u32(line) || !reader.get_u32(column))
+            return false;
+        pos = position_type(files[index], line, column);
+        return true;
+    }
+
+    static void write_token(BinaryWriter& writer,
+                            std::map<std::string, unsigned int>& files,
+                            const token_type& token)
+    {
+        writer.put_u32((unsigned int)boost::wave::token_id(token));
+        writer.put_string(token.get_value());
+        write_position(writer, files, token.get_position());
+    }
+
+    static bool read_token(BinaryReader& reader,
+                           std::vector<string_type>& files,
+                           token_type& token)
+    {
+        unsigned int id;
+        string_type value;
+        position_type pos;
+        if (!reader.get_u32(id) || !reader.get_string(value) ||
+            !read_position(reader, files, pos))
+        {
+            return false;
+        }
+        token = token_type(boost::wave::token_id(id), value, pos);
+        return true;
+    }
+};
+
+// Wave completes relative paths with the initial directory of the process.
+// If the current directory has been changed since (by the server), this
+// returns the absolute path to pass to Wave instead.
+std::string get_wave_path(const std::string& path)
+{
+    namespace fs = boost::filesystem;
+
+    fs::path p(path);
+    if (p.is_absolute())
+        return path;
+
+    boost::system::error_code ec;
+    fs::path current = fs::current_path(ec);
+    if (ec || current == boost::wave::util::initial_path())
+        return path;
+
+    return (current / p).string();
+}
+
+inline bool is_ident_char(char ch)
+{
+    return isalnum((unsigned char)ch) || ch == '_' || ch == '$';
+}
+
+// The number of the macros in the table of predefined.h
+static const size_t PREDEFINED_COUNT =
+    sizeof(s_predefined_macros) / sizeof(s_predefined_macros[0]) - 1;
+
+// PredefinedIndex --- finds a name in the table of predefined.h
+class PredefinedIndex : private boost::noncopyable
+{
+public:
+    static const PredefinedIndex& instance()
+    {
+        static PredefinedIndex s_index;
+        return s_index;
+    }
+
+    // Returns PREDEFINED_COUNT if not found
+    size_t find(const char *name, size_t length) const
+    {
+        unsigned char ch = (unsigned char)name[0];
+        if (ch >= 128 || length > MAX_LENGTH || !m_filter[ch][length])
+            return PREDEFINED_COUNT;
+
+        size_t lo = 0, hi = m_sorted.size();
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            const char *entry = s_predefined_macros[m_sorted[mid]].name;
+            int cmp = strncmp(entry, name, length);
+            if (cmp == 0 && entry[length] != 0)
+                cmp = 1;
+            if (cmp == 0)
+                return m_sorted[mid];
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return PREDEFINED_COUNT;
+    }
+
+    // Changes if the table changes
+    hash_type hash() const
+    {
+        return m_hash;
+    }
+
+protected:
+    static const size_t MAX_LENGTH = 63;
+    std::vector<size_t> m_sorted;           // indexes sorted by name
+    bool m_filter[128][MAX_LENGTH + 1];     // [first char][length]
+    hash_type m_hash;
+
+    struct NameLess
+    {
+        bool operator()(size_t a, size_t b) const
+        {
+            return strcmp(s_predefined_macros[a].name, s_predefined_macros[b].name) < 0;
+        }
+    };
+
+    PredefinedIndex() : m_hash(HASH_SEED)
+    {
+        memset(m_filter, 0, sizeof(m_filter));
+        for (size_t i = 0; i < PREDEFINED_COUNT; ++i)
+        {
+            const PREDEFINED_MACRO& macro = s_predefined_macros[i];
+            size_t length = strlen(macro.name);
+            unsigned char ch = (unsigned char)macro.name[0];
+            if (ch < 128 && length <= MAX_LENGTH)
+                m_filter[ch][length] = true;
+            m_sorted.push_back(i);
+
+            m_hash = hash_string(macro.name, m_hash);
+            m_hash = hash_string(macro.params ? macro.params : "", m_hash);
+            m_hash = hash_string(macro.value, m_hash);
+        }
+        std::sort(m_sorted.begin(), m_sorted.end(), NameLess());
+    }
+};
+
+// Defines a macro of the host compiler in the table of predefined.h.
+// Only the value is tokenized; Wave would parse a "name=value" string.
+template <typename T_CONTEXT>
+void add_predefined_macro(T_CONTEXT& context, const PREDEFINED_MACRO& macro)
+{
+    using namespace boost::wave;
+    typedef typename T_CONTEXT::token_type token_type;
+    typedef typename T_CONTEXT::lexer_type lexer_type;
+    typedef typename T_CONTEXT::position_type position_type;
+    typedef typename T_CONTEXT::token_sequence_type token_sequence_type;
+
+    const position_type pos("<command line>");
+    const language_support language = context.get_language();
+
+    std::vector<token_type> params;
+    if (macro.params)
+    {
+        const char *names = macro.params;
+        lexer_type it(names, names + strlen(names), pos, language), end;
+        for (; it != end && token_id(*it) != T_EOF; ++it)
+        {
+            if (token_id(*it) != T_COMMA &&
+                !IS_CATEGORY(*it, WhiteSpaceTokenType))
+            {
+                params.push_back(*it);
+            }
+        }
+    }
+
+    token_sequence_type tokens;
+    const char *value = macro.value;
+    lexer_type it(value, value + strlen(value), pos, language), end;
+    for (; it != end && token_id(*it) != T_EOF; ++it)
+    {
+        tokens.push_back(*it);
+    }
+
+    while (!tokens.empty() && IS_CATEGORY(tokens.front(), WhiteSpaceTokenType))
+        tokens.pop_front();
+    while (!tokens.empty() && IS_CATEGORY(tokens.back(), WhiteSpaceTokenType))
+        tokens.pop_back();
+
+    context.add_macro_definition(macro.name, pos, macro.params != NULL,
+                                 params, tokens, true);
+}
+
+// Most of the predefined macros are never used, so they are defined
+// lazily: before a text is processed, the predefined macros whose names
+// appear in it are defined, and so are those whose names are made by ##
+// (see MyContextPolicy::expanded_macro). A name is considered only once,
+// so that #undef and -U are respected.
+template <typename T_CONTEXT>
+void add_used_predefined_macro(T_CONTEXT& context, const char *name,
+                               size_t length)
+{
+    size_t i = PredefinedIndex::instance().find(name, length);
+    std::vector<bool>& considered = context.get_hooks().predefined_considered();
+    if (i == PREDEFINED_COUNT || considered[i])
+        return;
+    considered[i] = true;
+
+    // The definitions of Wave (e.g. __STDC_HOSTED__) take precedence
+    const PREDEFINED_MACRO& macro = s_predefined_macros[i];
+    if (!context.is_defined_macro(std::string(macro.name)))
+        add_predefined_macro(context, macro);
+}
+
+template <typename T_CONTEXT>
+void add_used_predefined_macros(T_CONTEXT& context, const char *first,
+                                const char *last)
+{
+    const char *p = first;
+    while (p < last)
+    {
+        if (!is_ident_char(*p))
+        {
+            ++p;
+            continue;
+        }
+
+        const char *name = p;
+        while (p < last && is_ident_char(*p))
+            ++p;
+        add_used_predefined_macro(context, name, p - name);
+    }
+}
+
+// Keeps a predefined macro from being defined lazily
+template <typename T_CONTEXT>
+void forget_predefined_macro(T_CONTEXT& context, const std::string& name)
+{
+    size_t i = PredefinedIndex::instance().find(name.c_str(), name.size());
+    if (i != PREDEFINED_COUNT)
+        context.get_hooks().predefined_considered()[i] = true;
+}
+
+// Adds an include path to the context and to the hooks which resolve #include
+template <typename T_CONTEXT>
+void add_search_path(T_CONTEXT& context, const std::string& path, bool is_system)
+{
+    bool added = is_system ? context.add_sysinclude_path(path.c_str())
+                           : context.add_include_path(path.c_str());
+    if (added)
+    {
+        using namespace boost::wave::util;
+        context.get_hooks().add_search_path(
+            complete_path(create_path(path), context.get_current_directory()),
+            path, is_system);
+    }
+}
+
+// NOTE: If snapshot is non-NULL, the predefined macros and the -D/-U options
+//       are restored from it instead.
+// NOTE: The predefined macros are defined by add_used_predefined_macros.
+template <typename T_CONTEXT>
+bool setup_context(T_CONTEXT& context, int argc, char **argv,
+                   const std::string& language,
+                   const MacroSnapshot<T_CONTEXT> *snapshot = NULL)
+{
+    using namespace boost;
+
+    if (language == "c++")
+    {
+        context.set_language(
+            wave::language_support(
+#if __cplusplus >= 201103L
+                wave::support_cpp11 |
+#else
+                wave::support_cpp |
+#endif
+                wave::support_option_variadics |
+                wave::support_option_long_long |
+                wave::support_option_emit_contnewlines |
+                wave::support_option_insert_whitespace |
+                wave::support_option_no_character_validation |
+                wave::support_option_convert_trigraphs |
+                wave::support_option_single_line |
+                wave::support_option_emit_line_directives |
+                wave::support_option_include_guard_detection |
+                wave::support_option_emit_pragma_directives));
+    }
+    else
+    {
+        context.set_language(
+            wave::language_support(
+                wave::support_c99 |
+                wave::support_option_variadics |
+                wave::support_option_long_long |
+                wave::support_option_emit_contnewlines |
+                wave::support_option_insert_whitespace |
+                wave::support_option_no_character_validation |
+                wave::support_option_convert_trigraphs |
+                wave::support_option_single_line |
+                wave::support_option_emit_line_directives |
+                wave::support_option_include_guard_detection |
+                wave::support_option_emit_pragma_directives));
+    }
+
+    if (snapshot)
+    {
+        snapshot->restore(context);
+    }
+    else
+    {
+        if (language == "rc")
+        {
+            context.add_macro_definition("RC_INVOKED=1", true);
+        }
+
+        // The -D options override the predefined macros
+        for (int i = 1; i < argc; ++i)
+        {
+            if (argv[i][0] == '-' && argv[i][1] == 'D')
+            {
+                std::string name = &argv[i][2];
+                forget_predefined_macro(context, name.substr(0, name.find_first_of("=(")));
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] == '-')
+        {
+            std::string str = argv[i];
+            if (str == "-dM" || str == "--stats" || str == "--output-thread" ||
+                str == "--macros-only" || str == "--cache-stats" ||
+                str == "--cache-clear" || str == "-M" || str == "-MD" ||
+                str == "--no-expansion-cache" || str == "--time-report")
+                continue;
+            if (str == "-o" || str == "-oM" || str == "-x" || str == "--batch" ||
+                str == "-j" || str == "--server" || str == "--client" ||
+                str == "--snapshot" || str == "--snapshot-save" ||
+                str == "--include-db" || str == "--cache" || str == "--cache-size" ||
+                str == "--incremental" || str == "-MF" || str == "-MT" ||
+                str == "--time-report-json" || str == "--macro-profile" ||
+                str == "--macro-stacks" || str == "--include-graph" ||
+                str == "--include-graph-dot")
+            {
+                ++i;
+                continue;
+            }
+
+            switch (argv[i][1])
+            {
+            case 'D':
+                if (!snapshot)
+                {
+                    size_t equal = str.find('=');
+                    if (equal != std::string::npos)
+                    {
+                        add_used_predefined_macros(context, &str[equal],
+                                                   &str[0] + str.size());
+                    }
+                    context.add_macro_definition(str.substr(2));
+                }
+                break;
+            case 'U':
+                if (!snapshot)
+                {
+                    forget_predefined_macro(context, str.substr(2));
+                    context.remove_macro_definition(str.substr(2));
+                }
+                break;
+            case 'I':
+                add_search_path(context, get_wave_path(&(argv[i][2])), false);
+                break;
+            case 'S':
+                add_search_path(context, get_wave_path(&(argv[i][2])), true);
+                break;
+            case 'E':
+                // ignored
+                break;
+            case 'j':
+                // -jN
+                break;
+            default:
+                std::cerr << "ERROR: invalid argument '" << str << "'\n";
+                return false;
+            }
+        }
+    }
+
+#ifdef _WIN32
+    const int MAX_ENV = 512;
+    #if defined(_MSC_VER) || defined(__BORLANDC__)
+        char szInclude[MAX_ENV];
+        if (GetEnvironmentVariableA("INCLUDE", szInclude, MAX_ENV))
+        {
+            add_search_path(context, szInclude, true);
+        }
+    #elif defined(__MINGW32__) || defined(__CYGWIN__) || defined(__clang__)
+        char szInclude[MAX_ENV], szHost[MAX_ENV];
+        if (GetEnvironmentVariableA("MINGW_PREFIX", szInclude, MAX_ENV))
+        {
+            strcat(szInclude, "/include");
+            add_search_path(context, szInclude, true);
+        }
+        if (GetEnvironmentVariableA("MINGW_PREFIX", szInclude, MAX_ENV) &&
+            GetEnvironmentVariableA("MINGW_CHOST", szHost, MAX_ENV))
+        {
+            strcat(szInclude, "/");
+            strcat(szInclude, szHost);
+            strcat(szInclude, "/include");
+            add_search_path(context, szInclude, true);
+        }
+    #endif
+#else   // ndef _WIN32
+    const char *path1 = getenv("CPATH"), path2 = NULL, path3 = NULL;
+    if (path1)
+    {
+        add_search_path(context, get_wave_path(path1), true);
+    }
+    if (language == "c" || language == "rc")
+    {
+        path2 = getenv("C_INCLUDE_PATH");
+        if (path2)
+        {
+            add_search_path(context, get_wave_path(path2), true);
+        }
+    }
+    else if (language == "c++")
+    {
+        path3 = getenv("CPLUS_INCLUDE_PATH");
+        if (path3)
+        {
+            add_search_path(context, get_wave_path(path3), true);
+        }
+    }
+    if (!path1 && !path2 && !path3)
+    {
+        add_search_path(context, "/usr/include", true);
+    }
+#endif  // ndef _WIN32
+
+    return true;
+}
+
+// The monotonic clock, in nanoseconds
+unsigned long long get_clock_ns()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER s_frequency;
+    if (s_frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&s_frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    unsigned long long ticks = counter.QuadPart, frequency = s_frequency.QuadPart;
+    return ticks / frequency * 1000000000ULL +
+           ticks % frequency * 1000000000ULL / frequency;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// The peak of the memory of the process, in bytes
+unsigned long long get_peak_rss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    #ifdef __APPLE__
+        return usage.ru_maxrss;
+    #else
+        return usage.ru_maxrss * 1024ULL;
+    #endif
+#endif
+}
+
+// PhaseTimer --- the time of a run spent in each phase (--time-report).
+// A thread is in one phase at a time, switched by the hooks and the loops
+// of preprocess, and the time since the last switch goes to the phase left.
+// The timer of a run is current on its thread, for the hooks and the input
+// policy, and is added to the TimeReport at the end.
+class PhaseTimer : private boost::noncopyable
+{
+public:
+    enum PHASE
+    {
+        OTHER,          // the setup and the caches
+        READING,        // readFile
+        LEXING,         // the iteration of Wave, except the following
+        DIRECTIVES,     // from a directive to the next token
+        CONDITIONS,     // the #if and #elif expressions
+        EXPANSION,      // from a macro to its rescanned result
+        OUTPUT,         // the writing of the blocks of the output
+        DEFINITIONS,    // print_definitions
+        NUM_PHASES
+    };
+    enum COUNTER
+    {
+        FILES_OPENED, BYTES_READ, TOKENS_EMITTED, MACROS_DEFINED,
+        MACROS_EXPANDED, GUARD_SKIPS, NUM_COUNTERS
+    };
+
+    explicit PhaseTimer(bool enabled)
+        : m_enabled(enabled), m_phase(OTHER), m_start(0), m_depth(0),
+          m_saved(OTHER), m_previous(NULL)
+    {
+        std::fill(m_times, m_times + NUM_PHASES, 0ULL);
+        std::fill(m_counters, m_counters + NUM_COUNTERS, 0ULL);
+        if (m_enabled)
+        {
+            m_start = get_clock_ns();
+            m_previous = current_ptr().get();
+            current_ptr().reset(this);
+        }
+    }
+    ~PhaseTimer();
+
+    // Returns the phase left. The clock is not read if it is the same.
+    PHASE switch_to(PHASE phase)
+    {
+        PHASE left = m_phase;
+        if (m_enabled && phase != left)
+        {
+            unsigned long long now = get_clock_ns();
+            m_times[left] += now - m_start;
+            m_start = now;
+            m_phase = phase;
+        }
+        return left;
+    }
+
+    void add(COUNTER counter, unsigned long long n = 1)
+    {
+        m_counters[counter] += n;
+    }
+
+    // The nested expansions are one
+    void begin_expansion()
+    {
+        if (m_depth++ == 0)
+            m_saved = switch_to(EXPANSION);
+    }
+    void end_expansion()
+    {
+        if (m_depth > 0 && --m_depth == 0)
+            switch_to(m_saved);
+    }
+
+    unsigned long long time(PHASE phase) const
+    {
+        return m_times[phase];
+    }
+    unsigned long long counter(COUNTER counter) const
+    {
+        return m_counters[counter];
+    }
+
+    // The timer of the run on this thread, or NULL
+    static PhaseTimer *current()
+    {
+        return current_ptr().get();
+    }
+    static PHASE enter(PHASE phase)
+    {
+        PhaseTimer *timer = current();
+        return timer ? timer->switch_to(phase) : phase;
+    }
+    static void count(COUNTER counter, unsigned long long n = 1)
+    {
+        if (PhaseTimer *timer = current())
+            timer->add(counter, n);
+    }
+
+    // Enters a phase until the end of the scope
+    class Scope : private boost::noncopyable
+    {
+    public:
+        explicit Scope(PHASE phase) : m_timer(current()), m_left(OTHER)
+        {
+            if (m_timer)
+                m_left = m_timer->switch_to(phase);
+        }
+        ~Scope()
+        {
+            if (m_timer)
+                m_timer->switch_to(m_left);
+        }
+
+    protected:
+        PhaseTimer *m_timer;
+        PHASE m_left;
+    };
+
+protected:
+    bool m_enabled;
+    PHASE m_phase;
+    unsigned long long m_start;
+    unsigned long long m_times[NUM_PHASES];
+    unsigned long long m_counters[NUM_COUNTERS];
+    unsigned int m_depth;           // the depth of the expansions
+    PHASE m_saved;                  // the phase before the expansions
+    PhaseTimer *m_previous;
+
+    static void no_cleanup(PhaseTimer *)
+    {
+    }
+    static boost::thread_specific_ptr<PhaseTimer>& current_ptr()
+    {
+        static boost::thread_specific_ptr<PhaseTimer> s_current(&no_cleanup);
+        return s_current;
+    }
+};
+
+// TimeReport --- the phases and the counters of the runs since start(),
+// written as text or as JSON. The times of parallel jobs are summed up.
+class TimeReport : private boost::noncopyable
+{
+public:
+    static TimeReport& instance()
+    {
+        static TimeReport s_report;
+        return s_report;
+    }
+
+    void start()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::fill(m_times, m_times + PhaseTimer::NUM_PHASES, 0ULL);
+        std::fill(m_counters, m_counters + PhaseTimer::NUM_COUNTERS, 0ULL);
+        m_runs = 0;
+        m_start = get_clock_ns();
+    }
+
+    void add(const PhaseTimer& timer)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        for (int i = 0; i < PhaseTimer::NUM_PHASES; ++i)
+            m_times[i] += timer.time(PhaseTimer::PHASE(i));
+        for (int i = 0; i < PhaseTimer::NUM_COUNTERS; ++i)
+            m_counters[i] += timer.counter(PhaseTimer::COUNTER(i));
+        ++m_runs;
+    }
+
+    void print(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        unsigned long long total = get_clock_ns() - m_start;
+        char buf[64];
+        out << "time report: " << m_runs << " runs\n";
+        for (int i = 0; i < PhaseTimer::NUM_PHASES; ++i)
+        {
+            std::sprintf(buf, "  %-20s %10.3f ms\n", s_phase_names[i],
+                         m_times[i] / 1e6);
+            out << buf;
+        }
+        std::sprintf(buf, "  %-20s %10.3f ms\n", "total (wall)", total / 1e6);
+        out << buf;
+        for (int i = 0; i < PhaseTimer::NUM_COUNTERS; ++i)
+        {
+            std::sprintf(buf, "  %-20s %10llu\n", s_counter_names[i], m_counters[i]);
+            out << buf;
+        }
+        std::sprintf(buf, "  %-20s %10llu KB\n", "peak_rss",
+                     get_peak_rss() / 1024);
+        out << buf;
+    }
+
+    void print_json(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        unsigned long long total = get_clock_ns() - m_start;
+        out << "{\n  \"runs\": " << m_runs << ",\n  \"phases_ns\": {";
+        for (int i = 0; i < PhaseTimer::NUM_PHASES; ++i)
+        {
+            out << (i ? ",\n" : "\n") << "    \"" << s_phase_names[i] << "\": " <<
+                   m_times[i];
+        }
+        out << "\n  },\n  \"total_ns\": " << total << ",\n  \"counters\": {";
+        for (int i = 0; i < PhaseTimer::NUM_COUNTERS; ++i)
+        {
+            out << (i ? ",\n" : "\n") << "    \"" << s_counter_names[i] << "\": " <<
+                   m_counters[i];
+        }
+        out << "\n  },\n  \"peak_rss_bytes\": " << get_peak_rss() << "\n}\n";
+    }
+
+protected:
+    boost::mutex m_mutex;
+    unsigned long long m_times[PhaseTimer::NUM_PHASES];
+    unsigned long long m_counters[PhaseTimer::NUM_COUNTERS];
+    size_t m_runs;
+    unsigned long long m_start;
+    static const char * const s_phase_names[PhaseTimer::NUM_PHASES];
+    static const char * const s_counter_names[PhaseTimer::NUM_COUNTERS];
+
+    TimeReport()
+    {
+        start();
+    }
+};
+
+const char * const TimeReport::s_phase_names[PhaseTimer::NUM_PHASES] =
+{
+    "other", "read_file", "lexing", "directives", "if_evaluation",
+    "macro_expansion", "output", "print_definitions"
+};
+const char * const TimeReport::s_counter_names[PhaseTimer::NUM_COUNTERS] =
+{
+    "files_opened", "bytes_read", "tokens_emitted", "macros_defined",
+    "macros_expanded", "include_guard_skips"
+};
+
+PhaseTimer::~PhaseTimer()
+{
+    if (!m_enabled)
+        return;
+    m_times[m_phase] += get_clock_ns() - m_start;
+    TimeReport::instance().add(*this);
+    current_ptr().reset(m_previous);
+}
+
+// MacroProfiler --- the expansions of each macro in a run (--macro-profile,
+// --macro-stacks), followed by the expansion hooks on a stack of frames.
+// The total time of a macro counts its outermost expansions only, the self
+// time excludes the nested ones, and the generated tokens are the tokens of
+// its rescanned result, besides the whitespace. The self time is also kept
+// for each stack of nested macros. The profiler of a run is current on its
+// thread and is added to the MacroProfile at the end.
+class MacroProfiler : private boost::noncopyable
+{
+public:
+    struct MACRO
+    {
+        unsigned long long count;
+        unsigned long long total;       // nanoseconds
+        unsigned long long self;        // nanoseconds
+        unsigned long long tokens;
+        unsigned int active;            // the frames of the macro
+
+        MACRO() : count(0), total(0), self(0), tokens(0), active(0)
+        {
+        }
+    };
+    typedef std::map<std::string, MACRO> macros_type;
+    typedef std::map<std::string, unsigned long long> stacks_type;
+
+    explicit MacroProfiler(bool enabled) : m_enabled(enabled), m_previous(NULL)
+    {
+        if (m_enabled)
+        {
+            m_previous = current_ptr().get();
+            current_ptr().reset(this);
+        }
+    }
+    ~MacroProfiler();
+
+    void expanding(const char *name)
+    {
+        FRAME frame;
+        frame.macro = &m_macros[name];
+        frame.path_length = m_path.size();
+        frame.children = 0;
+        if (!m_path.empty())
+            m_path += ';';
+        m_path += name;
+        ++frame.macro->active;
+        m_frames.push_back(frame);
+        m_frames.back().start = get_clock_ns();
+    }
+
+    void rescanned(unsigned long long tokens)
+    {
+        if (m_frames.empty())
+            return;
+        unsigned long long now = get_clock_ns();
+        FRAME frame = m_frames.back();
+        m_frames.pop_back();
+
+        unsigned long long total = now - frame.start;
+        unsigned long long self = total - std::min(total, frame.children);
+        MACRO& macro = *frame.macro;
+        ++macro.count;
+        macro.self += self;
+        macro.tokens += tokens;
+        if (--macro.active == 0)
+            macro.total += total;
+
+        m_stacks[m_path] += self;
+        m_path.resize(frame.path_length);
+        if (!m_frames.empty())
+            m_frames.back().children += total;
+    }
+
+    const macros_type& macros() const
+    {
+        return m_macros;
+    }
+    const stacks_type& stacks() const
+    {
+        return m_stacks;
+    }
+
+    // The profiler of the run on this thread, or NULL
+    static MacroProfiler *current()
+    {
+        return current_ptr().get();
+    }
+
+protected:
+    struct FRAME
+    {
+        MACRO *macro;
+        size_t path_length;             // of m_path before the frame
+        unsigned long long start;
+        unsigned long long children;    // the time of the nested frames
+    };
+
+    bool m_enabled;
+    macros_type m_macros;
+    stacks_type m_stacks;               // "A;B;C" -> the self time of C
+    std::vector<FRAME> m_frames;
+    std::string m_path;
+    MacroProfiler *m_previous;
+
+    static void no_cleanup(MacroProfiler *)
+    {
+    }
+    static boost::thread_specific_ptr<MacroProfiler>& current_ptr()
+    {
+        static boost::thread_specific_ptr<MacroProfiler> s_current(&no_cleanup);
+        return s_current;
+    }
+};
+
+// MacroProfile --- the macros of the runs since start(), written as a table
+// sorted by the self time, and the stacks in the folded format of the
+// flame graph tools ("A;B;C nanoseconds")
+class MacroProfile : private boost::noncopyable
+{
+public:
+    static MacroProfile& instance()
+    {
+        static MacroProfile s_profile;
+        return s_profile;
+    }
+
+    void start()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_macros.clear();
+        m_stacks.clear();
+    }
+
+    void add(const MacroProfiler& profiler)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        MacroProfiler::macros_type::const_iterator it, end = profiler.macros().end();
+        for (it = profiler.macros().begin(); it != end; ++it)
+        {
+            MacroProfiler::MACRO& macro = m_macros[it->first];
+            macro.count += it->second.count;
+            macro.total += it->second.total;
+            macro.self += it->second.self;
+            macro.tokens += it->second.tokens;
+        }
+        MacroProfiler::stacks_type::const_iterator stack;
+        for (stack = profiler.stacks().begin(); stack != profiler.stacks().end();
+             ++stack)
+        {
+            m_stacks[stack->first] += stack->second;
+        }
+    }
+
+    void print(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::vector<std::pair<unsigned long long, std::string> > order;
+        MacroProfiler::macros_type::const_iterator it, end = m_macros.end();
+        for (it = m_macros.begin(); it != end; ++it)
+            order.push_back(std::make_pair(it->second.self, it->first));
+        std::sort(order.rbegin(), order.rend());
+
+        char buf[128];
+        std::sprintf(buf, "%12s %12s %12s %12s  %s\n",
+                     "count", "total (ms)", "self (ms)", "tokens", "macro");
+        out << buf;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const MacroProfiler::MACRO& macro = m_macros[order[i].second];
+            std::sprintf(buf, "%12llu %12.3f %12.3f %12llu  ", macro.count,
+                         macro.total / 1e6, macro.self / 1e6, macro.tokens);
+            out << buf << order[i].second << '\n';
+        }
+    }
+
+    void print_stacks(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        MacroProfiler::stacks_type::const_iterator it, end = m_stacks.end();
+        for (it = m_stacks.begin(); it != end; ++it)
+            out << it->first << ' ' << it->second << '\n';
+    }
+
+protected:
+    boost::mutex m_mutex;
+    MacroProfiler::macros_type m_macros;
+    MacroProfiler::stacks_type m_stacks;
+
+    MacroProfile()
+    {
+    }
+};
+
+MacroProfiler::~MacroProfiler()
+{
+    if (!m_enabled)
+        return;
+    MacroProfile::instance().add(*this);
+    current_ptr().reset(m_previous);
+}
+
+// IncludeProfiler --- the include graph of a run (--include-graph), with
+// the cost of each file: the time and the tokens while it is the current
+// file (exclusive) and until it is closed (inclusive), the bytes read, and
+// the times it was included or skipped as guarded. The profiler of a run
+// is current on its thread and is added to the IncludeGraph at the end.
+class IncludeProfiler : private boost::noncopyable
+{
+public:
+    struct NODE
+    {
+        unsigned long long inclusions, skips;
+        unsigned long long bytes, bytes_inclusive;
+        unsigned long long tokens, tokens_inclusive;
+        unsigned long long time, time_inclusive;    // nanoseconds
+        unsigned int active;                        // the frames of the file
+
+        NODE()
+            : inclusions(0), skips(0), bytes(0), bytes_inclusive(0), tokens(0),
+              tokens_inclusive(0), time(0), time_inclusive(0), active(0)
+        {
+        }
+    };
+    struct EDGE
+    {
+        unsigned long long includes, skips;
+
+        EDGE() : includes(0), skips(0)
+        {
+        }
+    };
+    typedef std::map<std::string, NODE> nodes_type;
+    typedef std::map<std::pair<std::string, std::string>, EDGE> edges_type;
+
+    explicit IncludeProfiler(bool enabled)
+        : m_enabled(enabled), m_bytes(0), m_tokens(0), m_pending_bytes(0),
+          m_mark_time(0), m_mark_tokens(0), m_previous(NULL)
+    {
+        if (m_enabled)
+        {
+            m_previous = current_ptr().get();
+            current_ptr().reset(this);
+        }
+    }
+    ~IncludeProfiler();
+
+    // The input of the run
+    void start(const std::string& path, size_t bytes)
+    {
+        open(path, bytes);
+    }
+
+    // The size of the file read, which is opened next
+    void read(size_t bytes)
+    {
+        m_pending_bytes = bytes;
+    }
+
+    void opened(const std::string& path)
+    {
+        if (!m_frames.empty())
+            ++m_edges[std::make_pair(*m_frames.back().path, path)].includes;
+        open(path, m_pending_bytes);
+        m_pending_bytes = 0;
+    }
+
+    void skipped(const std::string& path)
+    {
+        ++m_nodes[path].skips;
+        if (!m_frames.empty())
+            ++m_edges[std::make_pair(*m_frames.back().path, path)].skips;
+    }
+
+    // The input is closed at the end
+    void returning()
+    {
+        if (m_frames.size() > 1)
+            close();
+    }
+
+    void add_token()
+    {
+        ++m_tokens;
+    }
+
+    const nodes_type& nodes() const
+    {
+        return m_nodes;
+    }
+    const edges_type& edges() const
+    {
+        return m_edges;
+    }
+
+    // The profiler of the run on this thread, or NULL
+    static IncludeProfiler *current()
+    {
+        return current_ptr().get();
+    }
+
+protected:
+    struct FRAME
+    {
+        NODE *node;
+        const std::string *path;
+        unsigned long long start, start_bytes, start_tokens;
+    };
+
+    bool m_enabled;
+    nodes_type m_nodes;
+    edges_type m_edges;                 // (includer, included) -> EDGE
+    std::vector<FRAME> m_frames;
+    unsigned long long m_bytes, m_tokens, m_pending_bytes;
+    unsigned long long m_mark_time, m_mark_tokens;  // the current file since
+    IncludeProfiler *m_previous;
+
+    // The time and the tokens since the mark go to the current file
+    void switch_file(unsigned long long now)
+    {
+        if (!m_frames.empty())
+        {
+            m_frames.back().node->time += now - m_mark_time;
+            m_frames.back().node->tokens += m_tokens - m_mark_tokens;
+        }
+        m_mark_time = now;
+        m_mark_tokens = m_tokens;
+    }
+
+    void open(const std::string& path, size_t bytes)
+    {
+        unsigned long long now = get_clock_ns();
+        switch_file(now);
+
+        nodes_type::iterator it = m_nodes.insert(std::make_pair(path, NODE())).first;
+        FRAME frame;
+        frame.node = &it->second;
+        frame.path = &it->first;
+        frame.start = now;
+        frame.start_bytes = m_bytes;
+        frame.start_tokens = m_tokens;
+        m_frames.push_back(frame);
+
+        ++frame.node->inclusions;
+        ++frame.node->active;
+        frame.node->bytes += bytes;
+        m_bytes += bytes;
+    }
+
+    void close()
+    {
+        unsigned long long now = get_clock_ns();
+        switch_file(now);
+
+        FRAME frame = m_frames.back();
+        m_frames.pop_back();
+        NODE& node = *frame.node;
+        if (--node.active == 0)
+        {
+            node.time_inclusive += now - frame.start;
+            node.bytes_inclusive += m_bytes - frame.start_bytes;
+            node.tokens_inclusive += m_tokens - frame.start_tokens;
+        }
+    }
+
+    static void no_cleanup(IncludeProfiler *)
+    {
+    }
+    static boost::thread_specific_ptr<IncludeProfiler>& current_ptr()
+    {
+        static boost::thread_specific_ptr<IncludeProfiler> s_current(&no_cleanup);
+        return s_current;
+    }
+};
+
+// IncludeGraph --- the include graphs of the runs since start(), written as
+// JSON or as a graph of Graphviz, where the files are darker by their
+// exclusive time
+class IncludeGraph : private boost::noncopyable
+{
+public:
+    static IncludeGraph& instance()
+    {
+        static IncludeGraph s_graph;
+        return s_graph;
+    }
+
+    void start()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_nodes.clear();
+        m_edges.clear();
+    }
+
+    void add(const IncludeProfiler& profiler)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        IncludeProfiler::nodes_type::const_iterator it, end = profiler.nodes().end();
+        for (it = profiler.nodes().begin(); it != end; ++it)
+        {
+            IncludeProfiler::NODE& node = m_nodes[it->first];
+            node.inclusions += it->second.inclusions;
+            node.skips += it->second.skips;
+            node.bytes += it->second.bytes;
+            node.bytes_inclusive += it->second.bytes_inclusive;
+            node.tokens += it->second.tokens;
+            node.tokens_inclusive += it->second.tokens_inclusive;
+            node.time += it->second.time;
+            node.time_inclusive += it->second.time_inclusive;
+        }
+        IncludeProfiler::edges_type::const_iterator edge;
+        for (edge = profiler.edges().begin(); edge != profiler.edges().end(); ++edge)
+        {
+            m_edges[edge->first].includes += edge->second.includes;
+            m_edges[edge->first].skips += edge->second.skips;
+        }
+    }
+
+    void print_json(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out << "{\n  \"files\": [";
+        IncludeProfiler::nodes_type::const_iterator it, end = m_nodes.end();
+        for (it = m_nodes.begin(); it != end; ++it)
+        {
+            const IncludeProfiler::NODE& node = it->second;
+            out << (it == m_nodes.begin() ? "\n" : ",\n") <<
+                   "    {\"file\": " << quote(it->first) <<
+                   ", \"inclusions\": " << node.inclusions <<
+                   ", \"skipped\": " << node.skips <<
+                   ", \"time_ns\": " << node.time <<
+                   ", \"time_inclusive_ns\": " << node.time_inclusive <<
+                   ", \"bytes\": " << node.bytes <<
+                   ", \"bytes_inclusive\": " << node.bytes_inclusive <<
+                   ", \"tokens\": " << node.tokens <<
+                   ", \"tokens_inclusive\": " << node.tokens_inclusive << "}";
+        }
+        out << "\n  ],\n  \"includes\": [";
+        IncludeProfiler::edges_type::const_iterator edge;
+        for (edge = m_edges.begin(); edge != m_edges.end(); ++edge)
+        {
+            out << (edge == m_edges.begin() ? "\n" : ",\n") <<
+                   "    {\"from\": " << quote(edge->first.first) <<
+                   ", \"to\": " << quote(edge->first.second) <<
+                   ", \"includes\": " << edge->second.includes <<
+                   ", \"skipped\": " << edge->second.skips << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void print_dot(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        unsigned long long max_time = 1;
+        IncludeProfiler::nodes_type::const_iterator it, end = m_nodes.end();
+        for (it = m_nodes.begin(); it != end; ++it)
+            max_time = std::max(max_time, it->second.time);
+
+        out << "digraph includes {\n"
+               "    node [shape=box, style=filled, fontname=\"monospace\"];\n";
+        for (it = m_nodes.begin(); it != end; ++it)
+        {
+            const IncludeProfiler::NODE& node = it->second;
+            std::string name =
+                boost::filesystem::path(it->first).filename().string();
+            char label[256];
+            std::sprintf(label, "\\n%.3f ms (%.3f ms inclusive)"
+                         "\\n%llu bytes, %llu tokens"
+                         "\\n%llu included, %llu skipped",
+                         node.time / 1e6, node.time_inclusive / 1e6,
+                         node.bytes, node.tokens, node.inclusions, node.skips);
+            std::string text = quote(name);
+            text.insert(text.size() - 1, label);
+            char color[32];
+            std::sprintf(color, "0.000 %.3f 1.000", double(node.time) / max_time);
+            out << "    " << quote(it->first) << " [label=" << text <<
+                   ", tooltip=" << quote(it->first) <<
+                   ", fillcolor=\"" << color << "\"];\n";
+        }
+        IncludeProfiler::edges_type::const_iterator edge;
+        for (edge = m_edges.begin(); edge != m_edges.end(); ++edge)
+        {
+            // Only skipped: dashed
+            out << "    " << quote(edge->first.first) << " -> " <<
+                   quote(edge->first.second) << " [label=\"" <<
+                   edge->second.includes;
+            if (edge->second.skips)
+                out << ", " << edge->second.skips << " skipped";
+            out << "\"" << (edge->second.includes ? "" : ", style=dashed") <<
+                   "];\n";
+        }
+        out << "}\n";
+    }
+
+protected:
+    boost::mutex m_mutex;
+    IncludeProfiler::nodes_type m_nodes;
+    IncludeProfiler::edges_type m_edges;
+
+    IncludeGraph()
+    {
+    }
+
+    // A string of JSON or Graphviz
+    static std::string quote(const std::string& str)
+    {
+        std::string ret = "\"";
+        for (size_t i = 0; i < str.size(); ++i)
+        {
+            unsigned char ch = str[i];
+            if (ch == '"' || ch == '\\')
+            {
+                ret += '\\';
+                ret += ch;
+            }
+            else if (ch < 0x20)
+            {
+                char buf[8];
+                std::sprintf(buf, "\\u%04x", ch);
+                ret += buf;
+            }
+            else
+            {
+                ret += ch;
+            }
+        }
+        ret += '"';
+        return ret;
+    }
+};
+
+IncludeProfiler::~IncludeProfiler()
+{
+    if (!m_enabled)
+        return;
+    while (!m_frames.empty())
+        close();
+    IncludeGraph::instance().add(*this);
+    current_ptr().reset(m_previous);
+}
+
+// SourceBuffer --- the text of a source file, memory-mapped if possible.
+// The text is always terminated by a newline, to avoid errors of Wave.
+class SourceBuffer : private boost::noncopyable
+{
+public:
+    // Files smaller than this are simply read
+    static const size_t MIN_MAP_SIZE = 16 * 1024;
+
+    SourceBuffer() : m_first(NULL), m_last(NULL), m_view(NULL), m_view_size(0)
+    {
+    }
+
+    ~SourceBuffer()
+    {
+        unload();
+    }
+
+    const char *begin() const
+    {
+        return m_first;
+    }
+    const char *end() const
+    {
+        return m_last;
+    }
+    size_t size() const
+    {
+        return m_last - m_first;
+    }
+    bool is_mapped() const
+    {
+        return m_view != NULL;
+    }
+
+    // The text reduced to the preprocessing directives, if extracted already
+    // (see get_directives)
+    boost::shared_ptr<const std::string> directives() const
+    {
+        boost::mutex::scoped_lock lock(m_directives_mutex);
+        return m_directives;
+    }
+    void set_directives(const boost::shared_ptr<const std::string>& directives) const
+    {
+        boost::mutex::scoped_lock lock(m_directives_mutex);
+        m_directives = directives;
+    }
+
+    bool load(const char *filePath)
+    {
+        unload();
+        if (filePath == NULL)
+            return false;
+
+        if (map_file(filePath))
+            return true;
+
+        return read_file(filePath);
+    }
+
+    void unload()
+    {
+        if (m_view)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_view);
+#else
+            munmap(m_view, m_view_size);
+#endif
+            m_view = NULL;
+            m_view_size = 0;
+        }
+        std::string().swap(m_text);
+        m_first = m_last = NULL;
+        m_directives.reset();
+    }
+
+protected:
+    const char *m_first;
+    const char *m_last;
+    void *m_view;
+    size_t m_view_size;
+    std::string m_text;     // used if not mapped
+    mutable boost::mutex m_directives_mutex;
+    mutable boost::shared_ptr<const std::string> m_directives;
+
+    // Map a regular file. If the file doesn't end with a newline, the
+    // newline is written into the slack of the last page, which is private
+    // to this process. A page-aligned file has no slack and is read instead.
+    bool map_file(const char *filePath)
+    {
+#ifdef _WIN32
+        HANDLE hFile = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ,
+                                   NULL, OPEN_EXISTING,
+                                   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER file_size;
+        if (GetFileType(hFile) != FILE_TYPE_DISK ||
+            !GetFileSizeEx(hFile, &file_size) ||
+            file_size.QuadPart < (LONGLONG)MIN_MAP_SIZE ||
+            file_size.QuadPart >= 0x7FFFFFFF)
+        {
+            CloseHandle(hFile);
+            return false;
+        }
+        size_t size = (size_t)file_size.QuadPart;
+
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY,
+                                             0, 0, NULL);
+        CloseHandle(hFile);
+        if (hMapping == NULL)
+            return false;
+
+        char *view = (char *)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(hMapping);
+        if (view == NULL)
+            return false;
+
+        size_t page_size = info.dwPageSize;
+#else
+        int fd = open(filePath, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size < (off_t)MIN_MAP_SIZE)
+        {
+            close(fd);
+            return false;
+        }
+        size_t size = (size_t)st.st_size;
+
+        void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            return false;
+
+        char *view = (char *)addr;
+        size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    #ifdef POSIX_MADV_SEQUENTIAL
+        posix_madvise(view, size, POSIX_MADV_SEQUENTIAL);
+    #endif
+#endif
+        m_view = view;
+        m_view_size = size;
+
+        if (view[size - 1] != '\n')
+        {
+            if (size % page_size == 0)
+            {
+                unload();
+                return false;
+            }
+            view[size++] = '\n';   // avoid errors
+        }
+
+        m_first = view;
+        m_last = view + size;
+        return true;
+    }
+
+    // Read a file which cannot be mapped (a pipe, a tiny file, ...)
+    bool read_file(const char *filePath)
+    {
+        std::ifstream fs(filePath, std::ios::in | std::ios::binary);
+        if (!fs)
+            return false;
+
+        char buf[64 * 1024];
+        while (fs.read(buf, sizeof(buf)) || fs.gcount() > 0)
+        {
+            m_text.append(buf, (size_t)fs.gcount());
+        }
+        m_text += '\n';     // avoid errors
+
+        m_first = m_text.data();
+        m_last = m_first + m_text.size();
+        return true;
+    }
+};
+
+// SourceCache --- the process-wide cache of source files.
+// Every file is loaded once and shared by all the inclusions of it.
+class SourceCache : private boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<const SourceBuffer> buffer_ptr;
+
+    static SourceCache& instance()
+    {
+        static SourceCache s_cache;
+        return s_cache;
+    }
+
+    // Returns NULL on failure
+    buffer_ptr load(const char *filePath)
+    {
+        FILE_ID id;
+        std::string canonical;
+        if (!get_file_id(filePath, canonical, id))
+        {
+            // not a regular file (a pipe etc.); never cached
+            boost::shared_ptr<SourceBuffer> buffer(new SourceBuffer);
+            if (!buffer->load(filePath))
+                return buffer_ptr();
+            return buffer;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            entries_type::iterator it = m_entries.find(canonical);
+            if (it != m_entries.end() && it->second.id == id)
+            {
+                ++m_hits;
+                return it->second.buffer;
+            }
+        }
+
+        // Load it without locking. If another thread was faster, use its one.
+        boost::shared_ptr<SourceBuffer> buffer(new SourceBuffer);
+        if (!buffer->load(filePath))
+            return buffer_ptr();
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        ENTRY& entry = m_entries[canonical];
+        if (entry.buffer && entry.id == id)
+        {
+            ++m_hits;
+            return entry.buffer;
+        }
+
+        ++m_misses;
+        m_bytes += buffer->size();
+
+        entry.id = id;
+        entry.buffer = buffer;
+        return buffer;
+    }
+
+    size_t hits() const
+    {
+        return m_hits;
+    }
+    size_t misses() const
+    {
+        return m_misses;
+    }
+    unsigned long long bytes() const
+    {
+        return m_bytes;
+    }
+
+    // The identity of a file. A changed file gets a different one.
+    struct FILE_ID
+    {
+        unsigned long long dev, ino, size, mtime;
+
+        bool operator==(const FILE_ID& other) const
+        {
+            return dev == other.dev && ino == other.ino &&
+                   size == other.size && mtime == other.mtime;
+        }
+    };
+
+    static bool get_file_id(const char *filePath, std::string& canonical,
+                            FILE_ID& id)
+    {
+        if (filePath == NULL)
+            return false;
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExA(filePath, GetFileExInfoStandard, &data) ||
+            (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            return false;
+        }
+
+        char szPath[MAX_PATH];
+        DWORD cch = GetFullPathNameA(filePath, MAX_PATH, szPath, NULL);
+        if (cch == 0 || cch >= MAX_PATH)
+            return false;
+        CharLowerA(szPath);
+        canonical = szPath;
+
+        id.dev = id.ino = 0;
+        id.size = ((unsigned long long)data.nFileSizeHigh << 32) |
+                  data.nFileSizeLow;
+        id.mtime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+                   data.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat st;
+        if (stat(filePath, &st) != 0 || !S_ISREG(st.st_mode))
+            return false;
+
+        char *path = realpath(filePath, NULL);
+        if (path == NULL)
+            return false;
+        canonical = path;
+        free(path);
+
+        id.dev = st.st_dev;
+        id.ino = st.st_ino;
+        id.size = st.st_size;
+    #if defined(__APPLE__)
+        id.mtime = st.st_mtimespec.tv_sec * 1000000000ULL + st.st_mtimespec.tv_nsec;
+    #else
+        id.mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    #endif
+#endif
+        return true;
+    }
+
+protected:
+    struct ENTRY
+    {
+        FILE_ID id;
+        buffer_ptr buffer;
+    };
+    typedef std::map<std::string, ENTRY> entries_type;
+
+    boost::mutex m_mutex;
+    entries_type m_entries;
+    size_t m_hits;
+    size_t m_misses;
+    unsigned long long m_bytes;
+
+    SourceCache() : m_hits(0), m_misses(0), m_bytes(0)
+    {
+    }
+};
+
+// SEARCH_PATHS --- the include paths of a context, as Wave keeps them:
+// (complete path, given path)
+struct SEARCH_PATHS
+{
+    typedef std::vector<std::pair<boost::filesystem::path, std::string> > list_type;
+    list_type user;         // -I
+    list_type system;       // -S and the environment
+    std::string key;        // identifies the lists
+};
+
+// IncludeResolver --- resolves #include like Wave, but remembers the
+// existence of every (directory, name) pair and every resolution until
+// clear() is called. Failed probes are the most of the probes. The
+// timestamps of the directories probed are kept, and validate() forgets
+// what depends on the directories modified since.
+class IncludeResolver : private boost::noncopyable
+{
+public:
+    struct RESULT
+    {
+        std::string path;       // the normalized complete path
+        std::string dir;        // the relative path, unless in_current_dir
+        bool in_current_dir;
+        std::vector<std::string> missing;   // the paths probed before it
+    };
+
+    static IncludeResolver& instance()
+    {
+        static IncludeResolver s_resolver;
+        return s_resolver;
+    }
+
+    bool resolve(const SEARCH_PATHS& paths, const boost::filesystem::path& current_dir,
+                 const std::string& name, bool is_system, const char *current_name,
+                 RESULT& result)
+    {
+        std::string key = paths.key;
+        key += is_system ? "<\n" : "\"\n";
+        key += current_dir.string();
+        key += '\n';
+        key += name;
+        if (current_name)
+        {
+            key += '\n';
+            key += current_name;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            ++m_lookups;
+            std::map<std::string, RESOLUTION>::iterator it = m_resolutions.find(key);
+            if (it != m_resolutions.end())
+            {
+                ++m_resolution_hits;
+                if (!it->second.found)
+                    return false;
+                result = it->second.result;
+                return true;
+            }
+        }
+
+        RESOLUTION resolution;
+        resolution.found = search(paths, current_dir, name, is_system,
+                                  current_name, resolution.result, resolution.dirs);
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_resolutions[key] = resolution;
+        result = resolution.result;
+        return resolution.found;
+    }
+
+    void clear()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_resolutions.clear();
+        m_probes.clear();
+        m_dir_stamps.clear();
+        m_lookups = m_resolution_hits = m_fs_probes = m_fs_misses = m_probe_hits = 0;
+    }
+
+    // Keeps the probes and the resolutions whose directories are unchanged,
+    // e.g. between the requests of a server
+    void validate()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_lookups = m_resolution_hits = m_fs_probes = m_fs_misses = m_probe_hits = 0;
+
+        std::set<std::string> changed;
+        std::map<std::string, long long>::iterator it = m_dir_stamps.begin();
+        while (it != m_dir_stamps.end())
+        {
+            if (it->second == RECENT_STAMP || get_dir_stamp(it->first) != it->second)
+            {
+                changed.insert(it->first);
+                m_dir_stamps.erase(it++);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if (changed.empty())
+            return;
+
+        std::map<std::string, bool>::iterator probe = m_probes.begin();
+        while (probe != m_probes.end())
+        {
+            std::string dir = boost::wave::util::branch_path(
+                boost::filesystem::path(probe->first)).string();
+            if (changed.count(dir))
+                m_probes.erase(probe++);
+            else
+                ++probe;
+        }
+
+        std::map<std::string, RESOLUTION>::iterator resolution = m_resolutions.begin();
+        while (resolution != m_resolutions.end())
+        {
+            const std::vector<std::string>& dirs = resolution->second.dirs;
+            size_t i = 0;
+            while (i < dirs.size() && !changed.count(dirs[i]) &&
+                   m_dir_stamps.count(dirs[i]))
+            {
+                ++i;
+            }
+            if (i < dirs.size())
+                m_resolutions.erase(resolution++);
+            else
+                ++resolution;
+        }
+    }
+
+    // Writes the resolutions with the timestamps of the directories searched.
+    // A directory modified just now may be modified again within its
+    // timestamp, so such resolutions are not written.
+    void write(BinaryWriter& writer)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        long long now = (long long)std::time(NULL);
+
+        std::vector<std::pair<const std::string *, const RESOLUTION *> > items;
+        std::vector<std::vector<long long> > stamps;
+        std::map<std::string, RESOLUTION>::const_iterator it, end = m_resolutions.end();
+        for (it = m_resolutions.begin(); it != end; ++it)
+        {
+            const RESOLUTION& resolution = it->second;
+            std::vector<long long> dir_stamps;
+            size_t i;
+            for (i = 0; i < resolution.dirs.size(); ++i)
+            {
+                long long stamp = get_dir_stamp(resolution.dirs[i]);
+                if (stamp >= now - 1)
+                    break;
+                dir_stamps.push_back(stamp);
+            }
+            if (i < resolution.dirs.size())
+                continue;
+
+            items.push_back(std::make_pair(&it->first, &resolution));
+            stamps.push_back(dir_stamps);
+        }
+
+        writer.put_u32((unsigned int)items.size());
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            const RESOLUTION& resolution = *items[i].second;
+            writer.put_string(*items[i].first);
+            writer.put_u8(resolution.found);
+            writer.put_string(resolution.result.path);
+            writer.put_string(resolution.result.dir);
+            writer.put_u8(resolution.result.in_current_dir);
+            writer.put_u32((unsigned int)resolution.result.missing.size());
+            for (size_t k = 0; k < resolution.result.missing.size(); ++k)
+                writer.put_string(resolution.result.missing[k]);
+            writer.put_u32((unsigned int)resolution.dirs.size());
+            for (size_t k = 0; k < resolution.dirs.size(); ++k)
+            {
+                writer.put_string(resolution.dirs[k]);
+                writer.put_u64((unsigned long long)stamps[i][k]);
+            }
+        }
+    }
+
+    // Reads the resolutions whose directories have not been modified since.
+    // Returns the number of them, or -1 if invalid.
+    int read(BinaryReader& reader)
+    {
+        unsigned int count;
+        if (!reader.get_u32(count))
+            return -1;
+
+        int valid = 0;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            std::string key;
+            RESOLUTION resolution;
+            unsigned char found, in_current_dir;
+            unsigned int num_missing, num_dirs;
+            if (!reader.get_string(key) || !reader.get_u8(found) ||
+                !reader.get_string(resolution.result.path) ||
+                !reader.get_string(resolution.result.dir) ||
+                !reader.get_u8(in_current_dir) || !reader.get_u32(num_missing))
+            {
+                return -1;
+            }
+            for (unsigned int k = 0; k < num_missing; ++k)
+            {
+                std::string path;
+                if (!reader.get_string(path))
+                    return -1;
+                resolution.result.missing.push_back(path);
+            }
+            if (!reader.get_u32(num_dirs))
+                return -1;
+            resolution.found = (found != 0);
+            resolution.result.in_current_dir = (in_current_dir != 0);
+
+            bool unchanged = true;
+            std::vector<long long> stamps;
+            for (unsigned int k = 0; k < num_dirs; ++k)
+            {
+                std::string dir;
+                unsigned long long stamp;
+                if (!reader.get_string(dir) || !reader.get_u64(stamp))
+                    return -1;
+                if (unchanged && get_dir_stamp(dir) != (long long)stamp)
+                    unchanged = false;
+                resolution.dirs.push_back(dir);
+                stamps.push_back((long long)stamp);
+            }
+
+            if (unchanged)
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_resolutions[key] = resolution;
+                for (unsigned int k = 0; k < num_dirs; ++k)
+                    m_dir_stamps.insert(std::make_pair(resolution.dirs[k], stamps[k]));
+                ++valid;
+            }
+        }
+        return valid;
+    }
+
+    void print_stats(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out << "include resolution: " << m_lookups << " lookups, " <<
+               m_resolution_hits << " reused; " << m_fs_probes <<
+               " filesystem probes (" << m_fs_misses << " not found), " <<
+               m_probe_hits << " probes cached\n";
+    }
+
+protected:
+    struct RESOLUTION
+    {
+        bool found;
+        RESULT result;
+        std::vector<std::string> dirs;  // the directories searched
+    };
+    boost::mutex m_mutex;
+    std::map<std::string, RESOLUTION> m_resolutions;
+    std::map<std::string, bool> m_probes;   // path -> exists
+    std::map<std::string, long long> m_dir_stamps;  // directory -> stamp
+    size_t m_lookups, m_resolution_hits, m_fs_probes, m_fs_misses, m_probe_hits;
+
+    // The stamp of a directory modified just now, which may be modified
+    // again within its timestamp
+    static const long long RECENT_STAMP = -2;
+
+    IncludeResolver()
+        : m_lookups(0), m_resolution_hits(0), m_fs_probes(0), m_fs_misses(0),
+          m_probe_hits(0)
+    {
+    }
+
+    // The modification time of a directory, or -1 if none
+    static long long get_dir_stamp(const std::string& dir)
+    {
+        boost::system::error_code ec;
+        std::time_t stamp = boost::filesystem::last_write_time(dir, ec);
+        return ec ? -1 : (long long)stamp;
+    }
+
+    // Probes a file, remembering the directory it depends on
+    bool exists(const boost::filesystem::path& path, std::vector<std::string>& dirs)
+    {
+        std::string dir = boost::wave::util::branch_path(path).string();
+        bool new_dir = (std::find(dirs.begin(), dirs.end(), dir) == dirs.end());
+        if (new_dir)
+            dirs.push_back(dir);
+
+        const std::string& key = path.string();
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            if (new_dir && !m_dir_stamps.count(dir))
+            {
+                // before the probe, which a later change must invalidate
+                long long stamp = get_dir_stamp(dir);
+                if (stamp >= (long long)std::time(NULL) - 1)
+                    stamp = RECENT_STAMP;
+                m_dir_stamps[dir] = stamp;
+            }
+            std::map<std::string, bool>::iterator it = m_probes.find(key);
+            if (it != m_probes.end())
+            {
+                ++m_probe_hits;
+                return it->second;
+            }
+        }
+
+        boost::system::error_code ec;
+        bool found = boost::filesystem::exists(path, ec);
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_fs_probes;
+        if (!found)
+            ++m_fs_misses;
+        m_probes[key] = found;
+        return found;
+    }
+
+    // The same order as include_paths::find_include_file of Wave
+    bool search(const SEARCH_PATHS& paths, const boost::filesystem::path& current_dir,
+                const std::string& name, bool is_system, const char *current_name,
+                RESULT& result, std::vector<std::string>& dirs)
+    {
+        using namespace boost::wave::util;
+        namespace fs = boost::filesystem;
+
+        fs::path name_path = create_path(name);
+        if (!is_system)
+        {
+            // The current directory first, unless #include_next
+            fs::path path = name_path;
+            if (!path.has_root_directory())
+                path = current_dir / name_path;
+
+            if (!current_name)
+            {
+                if (exists(path, dirs))
+                {
+                    result.path = normalize(path).string();
+                    result.in_current_dir = !name_path.has_root_directory();
+                    result.dir = name;
+                    return true;
+                }
+                result.missing.push_back(normalize(path).string());
+            }
+
+            if (search_list(paths.user, name_path, current_name, result, dirs))
+                return true;
+        }
+        return search_list(paths.system, name_path, current_name, result, dirs);
+    }
+
+    bool search_list(const SEARCH_PATHS::list_type& list,
+                     const boost::filesystem::path& name_path,
+                     const char *current_name, RESULT& result,
+                     std::vector<std::string>& dirs)
+    {
+        using namespace boost::wave::util;
+        namespace fs = boost::filesystem;
+
+        SEARCH_PATHS::list_type::const_iterator it = list.begin(), end = list.end();
+        if (current_name)
+        {
+            // #include_next: after the directory of the current file
+            fs::path file_path = create_path(current_name);
+            for (; it != end; ++it)
+            {
+                const fs::path& dir = it->first;
+                if (std::distance(dir.begin(), dir.end()) <=
+                        std::distance(file_path.begin(), file_path.end()) &&
+                    std::equal(dir.begin(), dir.end(), file_path.begin()))
+                {
+                    ++it;
+                    break;
+                }
+            }
+        }
+
+        for (; it != end; ++it)
+        {
+            fs::path path = name_path;
+            if (!path.has_root_directory())
+                path = it->first / name_path;
+
+            if (exists(path, dirs))
+            {
+                fs::path dir_path = name_path;
+                if (!dir_path.has_root_directory())
+                    dir_path = create_path(it->second) / name_path;
+
+                result.path = normalize(path).string();
+                result.dir = dir_path.string();
+                result.in_current_dir = false;
+                return true;
+            }
+            result.missing.push_back(normalize(path).string());
+        }
+        return false;
+    }
+};
+
+static const char INCLUDE_DB_SIGNATURE[] = "MZCPP-INCLUDEDB-2";
+
+// IncludeDatabase --- the include guards and the include resolutions of the
+// previous runs (--include-db). A guarded header is not opened again if its
+// guard is defined at the first #include of a run. A header is known by its
+// path while it has the same identity, or else the same contents.
+class IncludeDatabase : private boost::noncopyable
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string> > guards_type;
+
+    static IncludeDatabase& instance()
+    {
+        static IncludeDatabase s_database;
+        return s_database;
+    }
+
+    bool enabled() const
+    {
+        return m_enabled;
+    }
+
+    // Forgets everything and disables the database
+    void clear()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_enabled = false;
+        m_guards.clear();
+        m_loaded_guards = m_loaded_resolutions = m_guard_hits = m_skipped = 0;
+    }
+
+    // Enables the database with the contents of a file, if any.
+    // The resolutions go to the IncludeResolver.
+    void load(const std::string& file, std::ostream& err)
+    {
+        clear();
+        m_enabled = true;
+
+        std::ifstream fin(file.c_str(), std::ios::binary);
+        if (!fin.is_open())
+            return;     // not made yet
+        std::string data((std::istreambuf_iterator<char>(fin)),
+                         std::istreambuf_iterator<char>());
+
+        BinaryReader reader(data.c_str(), data.c_str() + data.size());
+        std::string signature;
+        hash_type version;
+        unsigned int count;
+        if (!reader.get_string(signature) || signature != INCLUDE_DB_SIGNATURE ||
+            !reader.get_u64(version) || version != get_version_hash() ||
+            !reader.get_u32(count))
+        {
+            err << "WARNING: invalid include database '" << file << "'; ignored\n";
+            return;
+        }
+
+        guards_map_type guards;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            std::string path;
+            GUARD guard;
+            if (!reader.get_string(path) || !reader.get_u64(guard.id.dev) ||
+                !reader.get_u64(guard.id.ino) || !reader.get_u64(guard.id.size) ||
+                !reader.get_u64(guard.id.mtime) || !reader.get_u64(guard.hash) ||
+                !reader.get_string(guard.name))
+            {
+                err << "WARNING: invalid include database '" << file << "'; ignored\n";
+                return;
+            }
+            guards[path] = guard;
+        }
+
+        int resolutions = IncludeResolver::instance().read(reader);
+        if (resolutions < 0 || !reader.at_end())
+        {
+            IncludeResolver::instance().clear();
+            err << "WARNING: invalid include database '" << file << "'; ignored\n";
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_guards.swap(guards);
+        m_loaded_guards = m_guards.size();
+        m_loaded_resolutions = resolutions;
+    }
+
+    bool save(const std::string& file)
+    {
+        BinaryWriter writer;
+        writer.put_string(std::string(INCLUDE_DB_SIGNATURE));
+        writer.put_u64(get_version_hash());
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            writer.put_u32((unsigned int)m_guards.size());
+            guards_map_type::const_iterator it, end = m_guards.end();
+            for (it = m_guards.begin(); it != end; ++it)
+            {
+                const GUARD& guard = it->second;
+                writer.put_string(it->first);
+                writer.put_u64(guard.id.dev);
+                writer.put_u64(guard.id.ino);
+                writer.put_u64(guard.id.size);
+                writer.put_u64(guard.id.mtime);
+                writer.put_u64(guard.hash);
+                writer.put_string(guard.name);
+            }
+        }
+        IncludeResolver::instance().write(writer);
+
+        // Replace it at once, for the other processes
+        std::string temp = file + ".tmp";
+        {
+            std::ofstream fout(temp.c_str(), std::ios::binary);
+            fout.write(writer.data().c_str(), writer.data().size());
+            if (!fout.good())
+                return false;
+        }
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp, file, ec);
+        return !ec;
+    }
+
+    // Gets the guard macro of a header of the previous runs,
+    // or "__BOOST_WAVE_PRAGMA_ONCE__" for #pragma once
+    bool find_guard(const std::string& path, std::string& name)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        guards_map_type::iterator it = m_guards.find(path);
+        if (it == m_guards.end())
+            return false;
+
+        GUARD& guard = it->second;
+        if (!guard.checked)
+        {
+            // Check it once per run
+            std::string canonical;
+            SourceCache::FILE_ID id;
+            if (!SourceCache::get_file_id(path.c_str(), canonical, id))
+            {
+                m_guards.erase(it);
+                return false;
+            }
+            if (!(id == guard.id))
+            {
+                SourceCache::buffer_ptr code = SourceCache::instance().load(path.c_str());
+                if (!code || hash_bytes(code->begin(), code->size()) != guard.hash)
+                {
+                    m_guards.erase(it);
+                    return false;
+                }
+                guard.id = id;  // touched only
+            }
+            guard.checked = true;
+        }
+
+        ++m_guard_hits;
+        name = guard.name;
+        return true;
+    }
+
+    // Counts a header not opened thanks to the database
+    void add_skipped()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_skipped;
+    }
+
+    // Records the guards detected in the headers read by a run, with the
+    // identities and the contents of the headers now. The guards restored
+    // from a snapshot or a checkpoint may be stale, and are not passed.
+    void add_guards(const guards_type& guards)
+    {
+        for (size_t i = 0; i < guards.size(); ++i)
+        {
+            const std::string& path = guards[i].first;
+            const std::string& name = guards[i].second;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                guards_map_type::iterator it = m_guards.find(path);
+                if (it != m_guards.end() && it->second.checked &&
+                    it->second.name == name)
+                {
+                    continue;
+                }
+            }
+
+            GUARD guard;
+            std::string canonical;
+            if (!SourceCache::get_file_id(path.c_str(), canonical, guard.id))
+                continue;
+            SourceCache::buffer_ptr code = SourceCache::instance().load(path.c_str());
+            if (!code)
+                continue;
+            guard.hash = hash_bytes(code->begin(), code->size());
+            guard.name = name;
+            guard.checked = true;
+
+            boost::mutex::scoped_lock lock(m_mutex);
+            m_guards[path] = guard;
+        }
+    }
+
+    void print_stats(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out << "include database: " << m_loaded_guards << " guards and " <<
+               m_loaded_resolutions << " resolutions loaded, " << m_guard_hits <<
+               " includes of known headers, " << m_skipped << " headers skipped\n";
+    }
+
+protected:
+    struct GUARD
+    {
+        SourceCache::FILE_ID id;
+        hash_type hash;
+        std::string name;
+        bool checked;       // validated in this run
+
+        GUARD() : checked(false)
+        {
+        }
+    };
+    typedef std::map<std::string, GUARD> guards_map_type;
+
+    boost::mutex m_mutex;
+    bool m_enabled;
+    guards_map_type m_guards;
+    size_t m_loaded_guards, m_loaded_resolutions, m_guard_hits, m_skipped;
+
+    IncludeDatabase()
+        : m_enabled(false), m_loaded_guards(0), m_loaded_resolutions(0),
+          m_guard_hits(0), m_skipped(0)
+    {
+    }
+
+    // The database of another build of mzcpp is not used
+    static hash_type get_version_hash()
+    {
+        hash_type hash = hash_string(INCLUDE_DB_SIGNATURE);
+        return hash_bytes(BOOST_LIB_VERSION, sizeof(BOOST_LIB_VERSION), hash);
+    }
+};
+
+// ExpressionCache --- the values of the #if and #elif expressions, keyed by
+// their tokens after the macro expansion. Those tokens refer to no macro,
+// so an entry is valid for any file and any definitions.
+class ExpressionCache : private boost::noncopyable
+{
+public:
+    typedef boost::wave::grammars::value_error value_error;
+
+    static ExpressionCache& instance()
+    {
+        static ExpressionCache s_cache;
+        return s_cache;
+    }
+
+    bool find(const std::string& key, bool& value, value_error& status)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        entries_type::const_iterator it = m_entries.find(key);
+        if (it == m_entries.end())
+            return false;
+        ++m_hits;
+        value = it->second.value;
+        status = it->second.status;
+        return true;
+    }
+
+    void store(const std::string& key, bool value, value_error status)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_evaluated;
+        if (m_entries.size() >= MAX_ENTRIES)
+            m_entries.clear();
+        ENTRY& entry = m_entries[key];
+        entry.value = value;
+        entry.status = status;
+    }
+
+    void count_fallback()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_fallbacks;
+    }
+
+    void print_stats(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out << "#if expressions: " << m_evaluated << " evaluated, " <<
+               m_hits << " cached, " << m_fallbacks << " by the grammar\n";
+    }
+
+protected:
+    struct ENTRY
+    {
+        bool value;
+        value_error status;
+    };
+    typedef std::map<std::string, ENTRY> entries_type;
+    static const size_t MAX_ENTRIES = 65536;
+
+    boost::mutex m_mutex;
+    entries_type m_entries;
+    size_t m_evaluated, m_hits, m_fallbacks;
+
+    ExpressionCache() : m_evaluated(0), m_hits(0), m_fallbacks(0)
+    {
+    }
+};
+
+void print_stats(std::ostream& out)
+{
+    SourceCache& cache = SourceCache::instance();
+    out << "source cache: " << cache.hits() << " hits, " <<
+           cache.misses() << " misses, " << cache.bytes() << " bytes\n";
+    IncludeResolver::instance().print_stats(out);
+    ExpressionCache::instance().print_stats(out);
+    if (IncludeDatabase::instance().enabled())
+        IncludeDatabase::instance().print_stats(out);
+}
+
+// Returns the position after the end of the block comment
+const char *skip_block_comment(const char *p, const char *last)
+{
+    while (p + 1 < last)
+    {
+        p = static_cast<const char *>(std::memchr(p, '*', last - p - 1));
+        if (!p)
+            break;
+        if (p[1] == '/')
+            return p + 2;
+        ++p;
+    }
+    return last;
+}
+
+inline bool is_line_special(char ch)
+{
+    return ch == '\n' || ch == '\\' || ch == '/' || ch == '"' || ch == '\'';
+}
+
+// Returns the first newline, backslash, slash or quote from p, or last.
+// Sixteen characters are compared at once with SSE2.
+inline const char *find_line_special(const char *p, const char *last)
+{
+#ifdef MZCPP_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i apostrophe = _mm_set1_epi8('\'');
+    for (; last - p >= 16; p += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+                         _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, slash),
+                                      _mm_cmpeq_epi8(chunk, quote)),
+                         _mm_cmpeq_epi8(chunk, apostrophe)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(found);
+        if (mask)
+        {
+    #ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return p + index;
+    #else
+            return p + __builtin_ctz(mask);
+    #endif
+        }
+    }
+#endif
+    while (p < last && !is_line_special(*p))
+        ++p;
+    return p;
+}
+
+// Returns the position after the end of the literal. An unterminated
+// literal ends at the end of the line.
+const char *skip_literal(const char *p, const char *last)
+{
+    char quote = *p++;
+    for (; p < last && *p != '\n'; ++p)
+    {
+        if (*p == quote)
+            return p + 1;
+        if (*p == '\\' && p + 1 < last)
+            ++p;
+    }
+    return p;
+}
+
+// Returns the position after the end of the raw string literal R"delim(...)delim",
+// or NULL if p is not at the start of one.
+const char *skip_raw_string(const char *p, const char *last)
+{
+    const char *delim = p + 1;
+    const char *paren = delim;
+    while (paren < last && paren - delim <= 16 && *paren != '(')
+    {
+        if (*paren == '"' || *paren == '\\' || *paren == ' ' || *paren == '\n')
+            return NULL;
+        ++paren;
+    }
+    if (paren >= last || *paren != '(')
+        return NULL;
+
+    std::string close = ")" + std::string(delim, paren) + "\"";
+    const char *end = std::search(paren + 1, last, close.begin(), close.end());
+    return (end == last) ? last : end + close.size();
+}
+
+// Returns the position after the newline which ends the logical line
+// starting at p. The newlines in comments, in raw string literals and
+// after backslashes don't end it.
+const char *skip_logical_line(const char *line, const char *p, const char *last)
+{
+    while ((p = find_line_special(p, last)) < last)
+    {
+        switch (*p)
+        {
+        case '\n':
+            return p + 1;
+        case '\\':
+            if (p + 1 < last && p[1] == '\n')
+                p += 2;
+            else if (p + 2 < last && p[1] == '\r' && p[2] == '\n')
+                p += 3;
+            else
+                ++p;
+            break;
+        case '/':
+            if (p + 1 < last && p[1] == '*')
+            {
+                p = skip_block_comment(p + 2, last);
+            }
+            else if (p + 1 < last && p[1] == '/')
+            {
+                // A line comment can be continued by a backslash
+                for (p += 2; p < last && *p != '\n'; ++p)
+                {
+                    if (*p == '\\' && p + 1 < last && p[1] == '\n')
+                        ++p;
+                    else if (*p == '\\' && p + 2 < last && p[1] == '\r' && p[2] == '\n')
+                        p += 2;
+                }
+            }
+            else
+            {
+                ++p;
+            }
+            break;
+        case '"':
+            if (p > line && p[-1] == 'R' &&
+                (p - 1 == line || !is_ident_char(p[-2]) || p[-2] == 'L' ||
+                 p[-2] == 'u' || p[-2] == 'U' || p[-2] == '8'))
+            {
+                const char *end = skip_raw_string(p, last);
+                if (end)
+                {
+                    p = end;
+                    break;
+                }
+            }
+            p = skip_literal(p, last);
+            break;
+        case '\'':
+            p = skip_literal(p, last);
+            break;
+        default:
+            ++p;
+            break;
+        }
+    }
+    return last;
+}
+
+// Returns the position of the first token of the line from p, skipping
+// the spaces and the block comments
+const char *skip_leading_blanks(const char *p, const char *last)
+{
+    for (;;)
+    {
+        while (p < last && (*p == ' ' || *p == '\t' || *p == '\f' ||
+                            *p == '\v' || *p == '\r'))
+        {
+            ++p;
+        }
+        if (p + 1 < last && p[0] == '/' && p[1] == '*')
+            p = skip_block_comment(p + 2, last);
+        else
+            return p;
+    }
+}
+
+// Copies the preprocessing directives of the source, replacing the other
+// lines by empty lines so that the line numbers are kept.
+void extract_directives(const char *first, const char *last, std::string& out)
+{
+    out.clear();
+
+    const char *p = first;
+    while (p < last)
+    {
+        const char *line = p;
+        p = skip_leading_blanks(p, last);
+
+        bool directive = (p < last && *p == '#') ||
+                         (p + 1 < last && p[0] == '%' && p[1] == ':');
+        p = skip_logical_line(line, p, last);
+
+        if (directive)
+            out.append(line, p);
+        else
+            out.append(std::count(line, p, '\n'), '\n');
+    }
+}
+
+// Returns the directives of the source. They are extracted once and kept
+// with the text while the file is cached.
+boost::shared_ptr<const std::string> get_directives(const SourceBuffer& code)
+{
+    boost::shared_ptr<const std::string> directives = code.directives();
+    if (!directives)
+    {
+        boost::shared_ptr<std::string> text(new std::string);
+        extract_directives(code.begin(), code.end(), *text);
+        directives = text;
+        code.set_directives(directives);
+    }
+    return directives;
+}
+
+// Finds the lines of the #include directives outside #if in the text,
+// with the offsets of the lines. The checkpoints are found by the lines of
+// Wave, so the lines after a #line (even inside #if) are not taken.
+void find_top_level_includes(const char *first, const char *last,
+                             std::map<unsigned int, size_t>& includes)
+{
+    includes.clear();
+
+    unsigned int line_number = 1;
+    int depth = 0;
+    const char *p = first;
+    while (p < last)
+    {
+        const char *line = p;
+        p = skip_leading_blanks(p, last);
+
+        const char *name = NULL;
+        if (p < last && *p == '#')
+            name = p + 1;
+        else if (p + 1 < last && p[0] == '%' && p[1] == ':')
+            name = p + 2;
+        bool on_first_line = (std::find(line, p, '\n') == p);
+
+        if (name)
+        {
+            while (name < last && (*name == ' ' || *name == '\t'))
+                ++name;
+            const char *end = name;
+            while (end < last && is_ident_char(*end))
+                ++end;
+
+            std::string directive(name, end);
+            if (directive == "line" || (name < last && isdigit((unsigned char)*name)))
+            {
+                break;
+            }
+            else if (directive == "if" || directive == "ifdef" || directive == "ifndef")
+            {
+                ++depth;
+            }
+            else if (directive == "endif")
+            {
+                --depth;
+            }
+            else if (depth == 0 && on_first_line &&
+                     (directive == "include" || directive == "include_next"))
+            {
+                includes[line_number] = line - first;
+            }
+        }
+
+        p = skip_logical_line(line, p, last);
+        line_number += (unsigned int)std::count(line, p, '\n');
+    }
+}
+
+// Whether p is at the '#' of a directive ('#', '%:' or '??=')
+inline bool is_directive_start(const char *p, const char *last)
+{
+    return (p < last && *p == '#') ||
+           (p + 1 < last && p[0] == '%' && p[1] == ':') ||
+           (p + 2 < last && p[0] == '?' && p[1] == '?' && p[2] == '=');
+}
+
+// Returns the start of the first line from p which is a directive, or last.
+// The newlines before it are added to lines.
+const char *find_directive_line(const char *p, const char *last,
+                                unsigned int& lines)
+{
+    while (p < last)
+    {
+        const char *line = p;
+        p = skip_leading_blanks(p, last);
+        if (is_directive_start(p, last))
+        {
+            lines += (unsigned int)std::count(line, p, '\n');
+            return line;
+        }
+        p = skip_logical_line(line, p, last);
+        lines += (unsigned int)std::count(line, p, '\n');
+    }
+    return last;
+}
+
+// Reads the name of a directive or an identifier at p
+std::string read_identifier(const char *& p, const char *last)
+{
+    while (p < last && (*p == ' ' || *p == '\t'))
+        ++p;
+    const char *begin = p;
+    while (p < last && is_ident_char(*p))
+        ++p;
+    return std::string(begin, p);
+}
+
+// Detects the include guard of the text, as the lexer of Wave does: the
+// text is '#ifndef X' or '#if !defined(X)', '#define X' and '#endif' with
+// no tokens outside
+bool detect_include_guard(const char *first, const char *last,
+                          std::string& guard)
+{
+    enum { BEFORE_IF, BEFORE_DEFINE, INSIDE, AFTER_ENDIF } state = BEFORE_IF;
+    int depth = 0;
+    guard.clear();
+
+    const char *p = first;
+    while (p < last)
+    {
+        const char *line = p;
+        p = skip_leading_blanks(p, last);
+        bool blank = (p >= last || *p == '\n' || *p == '\r' ||
+                      (p + 1 < last && p[0] == '/' && p[1] == '/'));
+        bool directive = is_directive_start(p, last);
+        std::string name;
+        if (directive)
+        {
+            p += (*p == '#') ? 1 : (*p == '%') ? 2 : 3;
+            name = read_identifier(p, last);
+        }
+
+        switch (state)
+        {
+        case BEFORE_IF:
+            if (blank)
+                break;
+            if (name == "ifndef")
+            {
+                guard = read_identifier(p, last);
+            }
+            else if (name == "if")
+            {
+                while (p < last && (*p == ' ' || *p == '\t'))
+                    ++p;
+                if (p >= last || *p != '!')
+                    return false;
+                ++p;
+                if (read_identifier(p, last) != "defined")
+                    return false;
+                while (p < last && (*p == ' ' || *p == '\t'))
+                    ++p;
+                bool paren = (p < last && *p == '(');
+                if (paren)
+                    ++p;
+                guard = read_identifier(p, last);
+                while (p < last && (*p == ' ' || *p == '\t'))
+                    ++p;
+                if (paren && (p >= last || *p++ != ')'))
+                    return false;
+            }
+            if (guard.empty())
+                return false;
+            p = skip_leading_blanks(p, last);
+            if (p < last && *p != '\n' && *p != '\r' &&
+                !(p + 1 < last && p[0] == '/' && p[1] == '/'))
+            {
+                return false;
+            }
+            state = BEFORE_DEFINE;
+            depth = 1;
+            break;
+        case BEFORE_DEFINE:
+            if (blank)
+                break;
+            if (name != "define" || read_identifier(p, last) != guard)
+                return false;
+            state = INSIDE;
+            break;
+        case INSIDE:
+            if (name == "if" || name == "ifdef" || name == "ifndef")
+                ++depth;
+            else if (name == "endif" && --depth == 0)
+                state = AFTER_ENDIF;
+            break;
+        case AFTER_ENDIF:
+            if (!blank)
+                return false;
+            break;
+        }
+
+        p = skip_logical_line(line, p, last);
+    }
+    return state == AFTER_ENDIF;
+}
+
+class MyInputPolicy
+{
+public:
+    template <typename CONTEXT_IT_T>
+    class inner
+    {
+    public:
+        static void readFile(SourceCache::buffer_ptr& code, const char* filePath)
+        {
+            // Map or read file, unless cached
+            PhaseTimer::Scope phase(PhaseTimer::READING);
+            code = SourceCache::instance().load(filePath);
+            if (!code)
+            {
+                std::string msg = "Cannot open file '";
+                msg += (filePath == NULL) ? "(null)" : filePath;
+                msg += "'.";
+                throw std::runtime_error(msg.c_str());
+            }
+            PhaseTimer::count(PhaseTimer::FILES_OPENED);
+            PhaseTimer::count(PhaseTimer::BYTES_READ, code->size());
+            if (IncludeProfiler *profiler = IncludeProfiler::current())
+                profiler->read(code->size());
+        }
+
+        template<typename PositionT>
+        static void init_iterators(
+            CONTEXT_IT_T& context_it,
+            const PositionT& pos,
+            boost::wave::language_support language)
+        {
+            try
+            {
+                readFile(context_it.code, context_it.filename.c_str());
+            }
+            catch (const std::exception&)
+            {
+                BOOST_WAVE_THROW_CTX(
+                    context_it.ctx,
+                    boost::wave::preprocess_exception,
+                    bad_include_file,
+                    context_it.filename.c_str(),
+                    pos);
+                return;
+            }
+
+            const char *first = context_it.code->begin();
+            const char *last = context_it.code->end();
+            if (context_it.ctx.get_hooks().directives_only())
+            {
+                context_it.directives = get_directives(*context_it.code);
+                first = context_it.directives->c_str();
+                last = first + context_it.directives->size();
+            }
+            add_used_predefined_macros(context_it.ctx, first, last);
+
+            typedef typename CONTEXT_IT_T::iterator_type iterator_type;
+            context_it.first =
+                iterator_type(first, last, PositionT(context_it.filename),
+                              language);
+            context_it.last = iterator_type();
+        }
+
+    protected:
+        SourceCache::buffer_ptr code;
+        boost::shared_ptr<const std::string> directives;
+    };
+};
+
+// FileNameTable --- the file names of the token positions, each stored once.
+// The names are never removed nor moved, so they are read without locking.
+// The table lives as long as the process, across the requests of a server,
+// and grows by chunks up to the range of the indexes.
+class FileNameTable : private boost::noncopyable
+{
+public:
+    typedef BOOST_WAVE_STRINGTYPE string_type;
+
+    static FileNameTable& instance()
+    {
+        static FileNameTable s_table;
+        return s_table;
+    }
+
+    // Returns the index of the name, 0 for the empty name
+    unsigned int intern(const string_type& name)
+    {
+        // a lexer makes the positions of all its tokens with the same name
+        unsigned int *last = m_last.get();
+        if (!last)
+        {
+            last = new unsigned int(0);
+            m_last.reset(last);
+        }
+        if (get(*last) == name)
+            return *last;
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::map<string_type, unsigned int>::iterator it = m_indexes.find(name);
+        if (it != m_indexes.end())
+            return (*last = it->second);
+        if (m_size == MAX_SIZE)
+            throw std::runtime_error("too many file names");
+
+        unsigned int index = m_size;
+        string_type **&chunks = m_directories[index / (CHUNK_SIZE * CHUNK_SIZE)];
+        if (!chunks)
+            chunks = new string_type *[CHUNK_SIZE]();
+        string_type *&chunk = chunks[index / CHUNK_SIZE % CHUNK_SIZE];
+        if (!chunk)
+            chunk = new string_type[CHUNK_SIZE];
+        chunk[index % CHUNK_SIZE] = name;
+        m_indexes[name] = index;
+        ++m_size;
+        return (*last = index);
+    }
+
+    const string_type& get(unsigned int index) const
+    {
+        return m_directories[index / (CHUNK_SIZE * CHUNK_SIZE)]
+                            [index / CHUNK_SIZE % CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+protected:
+    // A directory holds CHUNK_SIZE chunks of CHUNK_SIZE names
+    static const unsigned int CHUNK_SIZE = 1024;
+    static const unsigned int MAX_DIRECTORIES = 4096;
+    static const unsigned int MAX_SIZE = 0xFFFFFFFF;
+
+    boost::mutex m_mutex;
+    string_type **m_directories[MAX_DIRECTORIES];
+    unsigned int m_size;
+    std::map<string_type, unsigned int> m_indexes;
+    boost::thread_specific_ptr<unsigned int> m_last;  // the last index per thread
+
+    FileNameTable() : m_size(0)
+    {
+        std::fill(m_directories, m_directories + MAX_DIRECTORIES,
+                  (string_type **)NULL);
+        m_directories[0] = new string_type *[CHUNK_SIZE]();
+        m_directories[0][0] = new string_type[CHUNK_SIZE];
+        m_indexes[string_type()] = m_size++;
+    }
+};
+
+// FilePosition --- the position of a token, with the index of its file name
+// in FileNameTable instead of a copy of the name
+class FilePosition
+{
+public:
+    typedef FileNameTable::string_type string_type;
+
+    FilePosition() : m_file(0), m_line(1), m_column(1)
+    {
+    }
+    explicit FilePosition(const string_type& file, std::size_t line = 1,
+                          std::size_t column = 1)
+        : m_file(FileNameTable::instance().intern(file)),
+          m_line((unsigned int)line), m_column((unsigned int)column)
+    {
+    }
+
+    const string_type& get_file() const
+    {
+        return FileNameTable::instance().get(m_file);
+    }
+    std::size_t get_line() const
+    {
+        return m_line;
+    }
+    std::size_t get_column() const
+    {
+        return m_column;
+    }
+
+    void set_file(const string_type& file)
+    {
+        m_file = FileNameTable::instance().intern(file);
+    }
+    void set_line(std::size_t line)
+    {
+        m_line = (unsigned int)line;
+    }
+    void set_column(std::size_t column)
+    {
+        m_column = (unsigned int)column;
+    }
+
+    friend bool operator==(const FilePosition& lhs, const FilePosition& rhs)
+    {
+        return lhs.m_file == rhs.m_file && lhs.m_line == rhs.m_line &&
+               lhs.m_column == rhs.m_column;
+    }
+    friend std::ostream& operator<<(std::ostream& out, const FilePosition& pos)
+    {
+        return out << pos.get_file() << ':' << pos.m_line << ':' << pos.m_column;
+    }
+
+protected:
+    unsigned int m_file;
+    unsigned int m_line, m_column;
+};
+
+typedef boost::wave::cpplexer::lex_token<FilePosition> token_type;
+
+// TokenArena --- the memory of the tokens and of the nodes of the token lists
+// of a context. The memory is cut from large blocks, reused while the context
+// is alive and released at once when the context and all its tokens are gone.
+// The blocks are aligned to their size, so a pointer finds its arena. The
+// tokens made outside any context go to a shared arena with a lock.
+class TokenArena : private boost::noncopyable
+{
+public:
+    // The arena of the contexts created on the thread while it is alive
+    class Scope : private boost::noncopyable
+    {
+    public:
+        Scope() : m_arena(new TokenArena), m_previous(current_ptr().get())
+        {
+            current_ptr().reset(m_arena);
+        }
+        ~Scope()
+        {
+            current_ptr().reset(m_previous);
+            m_arena->release();
+        }
+
+    protected:
+        TokenArena *m_arena;
+        TokenArena *m_previous;
+    };
+
+    static void *allocate(std::size_t size)
+    {
+        if (size > MAX_SIZE)
+            return ::operator new(size);
+
+        TokenArena *arena = current_ptr().get();
+        if (arena)
+            return arena->take(size);
+
+        boost::mutex::scoped_lock lock(shared_mutex());
+        return shared().take(size);
+    }
+
+    static void deallocate(void *p, std::size_t size)
+    {
+        if (!p)
+            return;
+        if (size > MAX_SIZE)
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        BLOCK *block = reinterpret_cast<BLOCK *>(
+            reinterpret_cast<std::size_t>(p) & ~(BLOCK_SIZE - 1));
+        TokenArena *arena = block->arena;
+        if (arena == current_ptr().get())
+        {
+            arena->give(p, size);
+        }
+        else if (arena == &shared())
+        {
+            boost::mutex::scoped_lock lock(shared_mutex());
+            arena->give(p, size);
+        }
+        else
+        {
+            // a token of another context is left to its arena
+            arena->release();
+        }
+    }
+
+protected:
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+    static const std::size_t GRANULE = 8;
+    static const std::size_t MAX_SIZE = 64;
+
+    struct BLOCK
+    {
+        TokenArena *arena;
+        BLOCK *next;
+    };
+    struct FREE
+    {
+        FREE *next;
+    };
+
+    boost::detail::atomic_count m_refs;     // the scope and the allocations
+    BLOCK *m_blocks;
+    char *m_next, *m_end;
+    FREE *m_free[MAX_SIZE / GRANULE];       // the free lists by size
+
+    TokenArena() : m_refs(1), m_blocks(NULL), m_next(NULL), m_end(NULL)
+    {
+        std::fill(m_free, m_free + MAX_SIZE / GRANULE, (FREE *)NULL);
+    }
+    ~TokenArena()
+    {
+        while (m_blocks)
+        {
+            BLOCK *next = m_blocks->next;
+            boost::alignment::aligned_free(m_blocks);
+            m_blocks = next;
+        }
+    }
+
+    static std::size_t get_index(std::size_t size)
+    {
+        return size ? (size - 1) / GRANULE : 0;
+    }
+
+    void *take(std::size_t size)
+    {
+        std::size_t index = get_index(size);
+        if (FREE *item = m_free[index])
+        {
+            m_free[index] = item->next;
+            ++m_refs;
+            return item;
+        }
+
+        std::size_t rounded = (index + 1) * GRANULE;
+        if (m_end - m_next < (std::ptrdiff_t)rounded)
+        {
+            void *memory = boost::alignment::aligned_alloc(BLOCK_SIZE,
+                                                           BLOCK_SIZE);
+            if (!memory)
+                throw std::bad_alloc();
+            BLOCK *block = static_cast<BLOCK *>(memory);
+            block->arena = this;
+            block->next = m_blocks;
+            m_blocks = block;
+            m_next = static_cast<char *>(memory) + sizeof(BLOCK);
+            m_end = static_cast<char *>(memory) + BLOCK_SIZE;
+        }
+
+        void *p = m_next;
+        m_next += rounded;
+        ++m_refs;
+        return p;
+    }
+
+    void give(void *p, std::size_t size)
+    {
+        std::size_t index = get_index(size);
+        FREE *item = static_cast<FREE *>(p);
+        item->next = m_free[index];
+        m_free[index] = item;
+        release();
+    }
+
+    void release()
+    {
+        if (--m_refs == 0)
+            delete this;
+    }
+
+    static void no_cleanup(TokenArena *)
+    {
+    }
+    static boost::thread_specific_ptr<TokenArena>& current_ptr()
+    {
+        static boost::thread_specific_ptr<TokenArena> s_current(&no_cleanup);
+        return s_current;
+    }
+
+    // never destroyed, for the tokens of the static objects
+    static TokenArena& shared()
+    {
+        static TokenArena *s_shared = new TokenArena;
+        return *s_shared;
+    }
+    static boost::mutex& shared_mutex()
+    {
+        static boost::mutex *s_mutex = new boost::mutex;
+        return *s_mutex;
+    }
+};
+
+// ArenaAllocator --- the allocator of the token lists of Wave, which are
+// declared with boost::fast_pool_allocator, rebound to the TokenArena
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator()
+    {
+    }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&)
+    {
+    }
+    ArenaAllocator(const boost::fast_pool_allocator<token_type>&)
+    {
+    }
+    operator boost::fast_pool_allocator<token_type>() const
+    {
+        return boost::fast_pool_allocator<token_type>();
+    }
+
+    pointer allocate(size_type n, const void * = NULL)
+    {
+        return static_cast<pointer>(TokenArena::allocate(n * sizeof(T)));
+    }
+    void deallocate(pointer p, size_type n)
+    {
+        TokenArena::deallocate(p, n * sizeof(T));
+    }
+
+    void construct(pointer p, const T& value)
+    {
+        new(static_cast<void *>(p)) T(value);
+    }
+    void destroy(pointer p)
+    {
+        p->~T();
+    }
+    size_type max_size() const
+    {
+        return std::size_t(-1) / sizeof(T);
+    }
+
+    friend bool operator==(const ArenaAllocator&, const ArenaAllocator&)
+    {
+        return true;
+    }
+    friend bool operator!=(const ArenaAllocator&, const ArenaAllocator&)
+    {
+        return false;
+    }
+};
+
+// Wave allocates its tokens and the nodes of its token lists here
+namespace boost {
+
+template <>
+template <typename U>
+struct fast_pool_allocator<token_type>::rebind
+{
+    typedef ArenaAllocator<U> other;
+};
+
+namespace wave { namespace cpplexer { namespace impl {
+
+template <>
+void *token_data<FilePosition::string_type, FilePosition>::operator new(
+    std::size_t size)
+{
+    return TokenArena::allocate(size);
+}
+
+template <>
+void token_data<FilePosition::string_type, FilePosition>::operator delete(
+    void *p, std::size_t size)
+{
+    TokenArena::deallocate(p, size);
+}
+
+}}} // namespace boost::wave::cpplexer::impl
+} // namespace boost
+
+// IfBlockStatus --- tells the lexers whether the text is skipped by #if.
+// The lexers created on the thread while it is alive ask its context.
+class IfBlockStatus : private boost::noncopyable
+{
+public:
+    template <typename ContextT>
+    explicit IfBlockStatus(const ContextT& ctx)
+        : m_ctx(&ctx), m_skipping(&Access<ContextT>::skipping),
+          m_previous(current_ptr().get())
+    {
+        current_ptr().reset(this);
+    }
+    ~IfBlockStatus()
+    {
+        current_ptr().reset(const_cast<IfBlockStatus *>(m_previous));
+    }
+
+    static const IfBlockStatus *current()
+    {
+        return current_ptr().get();
+    }
+
+    bool skipping() const
+    {
+        return (*m_skipping)(m_ctx);
+    }
+
+protected:
+    const void *m_ctx;
+    bool (*m_skipping)(const void *ctx);
+    const IfBlockStatus *m_previous;
+
+    // Wave keeps the status of the #if blocks protected
+    template <typename ContextT>
+    struct Access : ContextT
+    {
+        static bool skipping(const void *ctx)
+        {
+            bool (ContextT::*status)() const = &Access::get_if_block_status;
+            return !(static_cast<const ContextT *>(ctx)->*status)();
+        }
+    };
+
+    static void no_cleanup(IfBlockStatus *)
+    {
+    }
+    static boost::thread_specific_ptr<IfBlockStatus>& current_ptr()
+    {
+        static boost::thread_specific_ptr<IfBlockStatus> s_current(&no_cleanup);
+        return s_current;
+    }
+};
+
+// TokenIterator --- the lexer of Wave, skipping the lines inside the false
+// #if blocks. When the first token of a line which is not a directive is
+// skipped, the lexer is restarted at the next directive line, found by
+// find_directive_line without lexing the lines between.
+//
+// The lexer of Wave copies up to 192K of the text when it starts, so the
+// restarted lexer gets a window of the text ending at a line, and a larger
+// window at the end of it.
+class TokenIterator : public boost::wave::cpplexer::lex_iterator<token_type>
+{
+public:
+    typedef boost::wave::cpplexer::lex_iterator<token_type> base_type;
+    typedef token_type::position_type position_type;
+
+    TokenIterator()
+        : m_status(NULL), m_first(NULL), m_last(NULL), m_line_start(NULL),
+          m_line(0), m_window_end(NULL), m_window_size(0), m_at_bol(true),
+          m_clean(true), m_restarted(false)
+    {
+    }
+
+    // The text of a file
+    TokenIterator(const char *first, const char *last,
+                  const position_type& pos,
+                  boost::wave::language_support language)
+        : base_type(first, last, pos, language), m_status(IfBlockStatus::current()),
+          m_first(first), m_last(last), m_line_start(first),
+          m_line(pos.get_line()), m_language(language), m_window_end(NULL),
+          m_window_size(0), m_at_bol(true), m_clean(true), m_restarted(false)
+    {
+    }
+
+    // The text of a macro or an expression
+    template <typename IteratorT>
+    TokenIterator(const IteratorT& first, const IteratorT& last,
+                  const position_type& pos,
+                  boost::wave::language_support language)
+        : base_type(first, last, pos, language), m_status(NULL),
+          m_first(NULL), m_last(NULL), m_line_start(NULL), m_line(0),
+          m_window_end(NULL), m_window_size(0), m_at_bol(true), m_clean(true),
+          m_restarted(false)
+    {
+    }
+
+    TokenIterator& operator++()
+    {
+        increment();
+        return *this;
+    }
+    TokenIterator operator++(int)
+    {
+        TokenIterator old = *this;
+        increment();
+        return old;
+    }
+
+    // Called by #line
+    void set_position(const position_type& pos)
+    {
+        // The line of the current token gets the new number
+        if (m_status && !seek_line(base_type::operator*().get_position().get_line()))
+            m_status = NULL;
+        m_line = pos.get_line();
+        base_type::set_position(pos);
+    }
+
+    bool has_include_guards(std::string& guard_name) const
+    {
+        // The restarted lexer has seen a part of the text only
+        if (m_restarted)
+            return detect_include_guard(m_first, m_last, guard_name);
+        return base_type::has_include_guards(guard_name);
+    }
+
+protected:
+    enum
+    {
+        MIN_SKIP = 512,             // the lines to skip to restart the lexer
+        MIN_WINDOW = 8 * 1024,
+        MAX_WINDOW = 128 * 1024
+    };
+
+    const IfBlockStatus *m_status;  // NULL unless the text can be skipped
+    const char *m_first;
+    const char *m_last;
+    const char *m_line_start;       // the start of the line m_line
+    unsigned int m_line;
+    boost::wave::language_support m_language;
+    const char *m_window_end;       // the end of the text of the lexer
+    size_t m_window_size;
+    bool m_at_bol;                  // no token but blanks in the line so far
+    bool m_clean;                   // the line doesn't continue another
+    bool m_restarted;
+
+    void increment()
+    {
+        using namespace boost::wave;
+        if (!m_status)
+        {
+            base_type::operator++();
+            return;
+        }
+
+        const token_type& token = base_type::operator*();
+        token_id id = token_id(token);
+        bool newline = (id == T_NEWLINE || id == T_CPPCOMMENT);
+        if (newline)
+        {
+            if (m_at_bol && m_status->skipping() && skip_lines(token, true))
+                return;
+            m_at_bol = m_clean = true;
+        }
+        else if (m_at_bol)
+        {
+            if (id == T_CONTLINE ||
+                (id == T_CCOMMENT && token.get_value().find('\n') != token_type::string_type::npos))
+            {
+                m_clean = false;
+            }
+            else if (!IS_CATEGORY(id, WhiteSpaceTokenType) && id != T_EOF)
+            {
+                // Only the first token of a line which is not a directive
+                // is checked. The directives are parsed even if skipped.
+                m_at_bol = false;
+                if (!IS_CATEGORY(id, PPTokenType) && id != T_POUND &&
+                    id != T_POUND_ALT && id != T_POUND_TRIGRAPH &&
+                    m_clean && m_status->skipping() && skip_lines(token, false))
+                {
+                    return;
+                }
+            }
+        }
+
+        base_type::operator++();
+
+        // The end of a window is not the end of the file
+        while (m_window_end && m_window_end < m_last &&
+               token_id(base_type::operator*()) == T_EOF)
+        {
+            position_type pos = base_type::operator*().get_position();
+            m_line += (unsigned int)std::count(m_line_start, m_window_end, '\n');
+            m_line_start = m_window_end;
+            if (m_window_size < MAX_WINDOW)
+                m_window_size *= 2;
+            restart(m_window_end, m_line, pos);
+        }
+    }
+
+    // Moves m_line_start forward to the line
+    bool seek_line(unsigned int line)
+    {
+        if (line < m_line)
+            return false;
+        for (; m_line < line; ++m_line)
+        {
+            const char *newline = static_cast<const char *>(
+                std::memchr(m_line_start, '\n', m_last - m_line_start));
+            if (!newline)
+                return false;
+            m_line_start = newline + 1;
+        }
+        return true;
+    }
+
+    // Restarts the lexer at the next directive line after the token, unless
+    // it is near. The lexer starts at the newline before the directive,
+    // since Wave takes a '#' for a directive only after a newline.
+    bool skip_lines(const token_type& token, bool newline)
+    {
+        position_type pos = token.get_position();
+        unsigned int line = pos.get_line();
+        if (newline)
+        {
+            // The token ends the line
+            const token_type::string_type& value = token.get_value();
+            line += (unsigned int)std::count(value.begin(), value.end(), '\n');
+        }
+        if (!seek_line(line))
+        {
+            m_status = NULL;
+            return false;
+        }
+
+        const char *p = m_line_start;
+        if (!newline)
+        {
+            p = skip_logical_line(p, p, m_last);
+            line += (unsigned int)std::count(m_line_start, p, '\n');
+        }
+        const char *directive = find_directive_line(p, m_last, line);
+        if (directive - p < MIN_SKIP || directive[-1] != '\n')
+            return false;
+
+        m_line_start = directive;
+        m_line = line;
+        m_window_size = MIN_WINDOW;
+        restart(directive - 1, line - 1, pos);
+        m_at_bol = false;
+        m_clean = true;
+        return true;
+    }
+
+    // Starts the lexer at the line, for a window of the text
+    void restart(const char *start, unsigned int line, position_type pos)
+    {
+        // The window ends at a line not continued, after m_window_size
+        const char *end = start;
+        while (end < m_last && (size_t(end - start) < m_window_size ||
+                                (end - start >= 4 && std::memcmp(end - 4, "?\?/\n", 4) == 0)))
+        {
+            end = skip_logical_line(end, end, m_last);
+        }
+        m_window_end = end;
+
+        pos.set_line(line);
+        pos.set_column(1);
+        base_type::operator=(base_type(start, end, pos, m_language));
+        m_restarted = true;
+    }
+};
+
+// The lexer and the grammars of Wave are built for its own lexer and token only
+template struct boost::wave::cpplexer::new_lexer_gen<const char *, FilePosition,
+                                                     token_type>;
+typedef std::list<token_type, boost::fast_pool_allocator<token_type> >
+    token_sequence_type;
+template struct boost::wave::grammars::cpp_grammar_gen<TokenIterator,
+                                                       token_sequence_type>;
+template struct boost::wave::grammars::defined_grammar_gen<TokenIterator>;
+template struct boost::wave::grammars::has_include_grammar_gen<TokenIterator>;
+template struct boost::wave::grammars::predefined_macros_grammar_gen<TokenIterator>;
+template struct boost::wave::grammars::intlit_grammar_gen<token_type>;
+template struct boost::wave::grammars::chlit_grammar_gen<int, token_type>;
+template struct boost::wave::grammars::chlit_grammar_gen<unsigned int, token_type>;
+
+// ExpressionEvaluator --- evaluates the tokens of #if and #elif after the
+// macro expansion by precedence climbing, with the values and the operators
+// of the expression grammar of Wave. It fails on the tokens and the literals
+// it does not know and on the ill-formed expressions, and then the grammar
+// evaluates them (and reports the errors).
+class ExpressionEvaluator
+{
+public:
+    typedef boost::wave::grammars::closures::closure_value value_type;
+
+    explicit ExpressionEvaluator(const std::vector<const token_type *>& tokens)
+        : m_tokens(tokens), m_index(0)
+    {
+    }
+
+    bool evaluate(value_type& value)
+    {
+        m_index = 0;
+        return parse_conditional(value, true) && m_index == m_tokens.size();
+    }
+
+protected:
+    const std::vector<const token_type *>& m_tokens;
+    size_t m_index;
+
+    // The id of the next token as the grammar sees it: the alternative and
+    // trigraph spellings of some operators are accepted. T_UNKNOWN for the
+    // tokens not in the grammar.
+    boost::wave::token_id peek() const
+    {
+        using namespace boost::wave;
+        if (m_index >= m_tokens.size())
+            return T_EOF;
+
+        token_id id = token_id(*m_tokens[m_index]);
+        switch (id)
+        {
+        case T_QUESTION_MARK: case T_COLON:
+        case T_LEFTPAREN: case T_RIGHTPAREN:
+        case T_EQUAL: case T_LESS: case T_GREATER:
+        case T_LESSEQUAL: case T_GREATEREQUAL:
+        case T_SHIFTLEFT: case T_SHIFTRIGHT:
+        case T_PLUS: case T_MINUS: case T_STAR: case T_DIVIDE: case T_PERCENT:
+        case T_INTLIT: case T_PP_NUMBER:
+            return id;
+        default:
+            break;
+        }
+
+        id = token_id(id & MainTokenMask);
+        switch (id)
+        {
+        case T_OROR: case T_ANDAND: case T_OR: case T_XOR: case T_AND:
+        case T_NOTEQUAL: case T_COMPL: case T_NOT:
+            return id;
+        default:
+            return T_UNKNOWN;
+        }
+    }
+
+    // The precedence of a binary operator, 0 for the others
+    static int get_precedence(boost::wave::token_id id)
+    {
+        using namespace boost::wave;
+        switch (id)
+        {
+        case T_OROR:                                    return 1;
+        case T_ANDAND:                                  return 2;
+        case T_OR:                                      return 3;
+        case T_XOR:                                     return 4;
+        case T_AND:                                     return 5;
+        case T_EQUAL: case T_NOTEQUAL:                  return 6;
+        case T_LESS: case T_GREATER:
+        case T_LESSEQUAL: case T_GREATEREQUAL:          return 7;
+        case T_SHIFTLEFT: case T_SHIFTRIGHT:            return 8;
+        case T_PLUS: case T_MINUS:                      return 9;
+        case T_STAR: case T_DIVIDE: case T_PERCENT:     return 10;
+        default:                                        return 0;
+        }
+    }
+
+    // The operands of a decided || or && and its result are not calculated,
+    // like the "nocalc" rules of the grammar
+    bool parse_conditional(value_type& value, bool calc)
+    {
+        if (!parse_binary(value, 1, calc))
+            return false;
+        if (peek() != boost::wave::T_QUESTION_MARK)
+            return true;
+        ++m_index;
+
+        value_type first, second;
+        if (!parse_conditional(first, calc) ||
+            peek() != boost::wave::T_COLON)
+        {
+            return false;
+        }
+        ++m_index;
+        if (!parse_conditional(second, calc))
+            return false;
+
+        if (calc)
+            value = first.handle_questionmark(value, second);
+        return true;
+    }
+
+    bool parse_binary(value_type& value, int min_precedence, bool calc)
+    {
+        using namespace boost::wave;
+        if (!parse_unary(value, calc))
+            return false;
+
+        for (;;)
+        {
+            token_id id = peek();
+            int precedence = get_precedence(id);
+            if (precedence == 0 || precedence < min_precedence)
+                return true;
+            ++m_index;
+
+            bool decided = false;
+            if (id == T_OROR)
+                decided = as_bool(value);
+            else if (id == T_ANDAND)
+                decided = !as_bool(value);
+
+            value_type rhs;
+            if (!parse_binary(rhs, precedence + 1, calc && !decided))
+                return false;
+            if (!calc)
+                continue;
+
+            if (decided)
+            {
+                value = value_type(as_bool(value), value.is_valid());
+                continue;
+            }
+            switch (id)
+            {
+            case T_OROR:        value = (value || rhs); break;
+            case T_ANDAND:      value = (value && rhs); break;
+            case T_OR:          value = (value | rhs); break;
+            case T_XOR:         value = (value ^ rhs); break;
+            case T_AND:         value = (value & rhs); break;
+            case T_EQUAL:       value = (value == rhs); break;
+            case T_NOTEQUAL:    value = (value != rhs); break;
+            case T_LESS:        value = (value < rhs); break;
+            case T_GREATER:     value = (value > rhs); break;
+            case T_LESSEQUAL:   value = (value <= rhs); break;
+            case T_GREATEREQUAL: value = (value >= rhs); break;
+            case T_SHIFTLEFT:   value <<= rhs; break;
+            case T_SHIFTRIGHT:  value >>= rhs; break;
+            case T_PLUS:        value += rhs; break;
+            case T_MINUS:       value -= rhs; break;
+            case T_STAR:        value *= rhs; break;
+            case T_DIVIDE:      value /= rhs; break;
+            case T_PERCENT:     value %= rhs; break;
+            default:            break;
+            }
+        }
+    }
+
+    bool parse_unary(value_type& value, bool calc)
+    {
+        using namespace boost::wave;
+        token_id id = peek();
+        ++m_index;
+        switch (id)
+        {
+        case T_PLUS:
+            return parse_unary(value, calc);
+        case T_MINUS:
+            if (!parse_unary(value, calc))
+                return false;
+            if (calc)
+                value = -value;
+            return true;
+        case T_COMPL:
+            if (!parse_unary(value, calc))
+                return false;
+            if (calc)
+                value = ~value;
+            return true;
+        case T_NOT:
+            if (!parse_unary(value, calc))
+                return false;
+            if (calc)
+                value = !value;
+            return true;
+        case T_LEFTPAREN:
+            if (!parse_conditional(value, calc) || peek() != T_RIGHTPAREN)
+                return false;
+            ++m_index;
+            return true;
+        case T_INTLIT:
+        case T_PP_NUMBER:
+            return !calc || parse_integer(*m_tokens[m_index - 1], value);
+        default:
+            return false;
+        }
+    }
+
+    // Converts an integer literal like the intlit grammar of Wave: the octal
+    // and hexadecimal ones are unsigned, the decimal ones only if 'u' follows
+    // the digits. Fails on the overflows and the others.
+    static bool parse_integer(const token_type& token, value_type& value)
+    {
+        using boost::wave::int_literal_type;
+        using boost::wave::uint_literal_type;
+        const token_type::string_type& str = token.get_value();
+        const char *p = str.c_str(), *end = p + str.size();
+
+        unsigned int base = 10;
+        bool is_unsigned = false;
+        if (p != end && *p == '0')
+        {
+            ++p;
+            if (p != end && (*p == 'x' || *p == 'X'))
+            {
+                ++p;
+                if (p == end || !isxdigit((unsigned char)*p))
+                    return false;
+                base = 16;
+                is_unsigned = true;
+            }
+            else if (p != end && isdigit((unsigned char)*p))
+            {
+                base = 8;
+                is_unsigned = true;
+            }
+        }
+        else if (p == end || !isdigit((unsigned char)*p))
+        {
+            return false;
+        }
+
+        const uint_literal_type max_value = ~uint_literal_type(0);
+        uint_literal_type result = 0;
+        for (; p != end; ++p)
+        {
+            unsigned int digit;
+            if ('0' <= *p && *p <= '9')
+                digit = *p - '0';
+            else if (base == 16 && isxdigit((unsigned char)*p))
+                digit = (tolower((unsigned char)*p) - 'a') + 10;
+            else
+                break;
+            if (digit >= base || result > (max_value - digit) / base)
+                return false;
+            result = result * base + digit;
+        }
+
+        if (p != end && (*p == 'u' || *p == 'U'))
+            is_unsigned = true;
+        for (; p != end; ++p)
+        {
+            if (!strchr("uUlL", *p))
+                return false;
+        }
+
+        if (is_unsigned)
+            value = value_type(result);
+        else
+            value = value_type(static_cast<int_literal_type>(result));
+        return true;
+    }
+};
+
+// Evaluates the tokens by the expression grammar of Wave, as its
+// expression_grammar_gen does
+bool evaluate_by_grammar(token_sequence_type::const_iterator first,
+                         token_sequence_type::const_iterator last,
+                         const token_type::position_type& pos,
+                         bool if_block_status,
+                         boost::wave::grammars::value_error& status)
+{
+    using namespace boost::spirit::classic;
+    using namespace boost::wave;
+    using namespace boost::wave::grammars;
+    typedef token_sequence_type::const_iterator iterator_type;
+
+    closures::closure_value result;
+    parse_info<iterator_type> hit(first);
+    try
+    {
+        expression_grammar g;
+        hit = parse(first, last, g[assign_a(result)],
+                    ch_p(T_SPACE) | ch_p(T_CCOMMENT) | ch_p(T_CPPCOMMENT));
+    }
+    catch (const preprocess_exception&)
+    {
+        // the errors are not reported inside the false #if blocks
+        if (if_block_status)
+            throw;
+        return false;
+    }
+
+    // the whitespace and a newline may follow the expression
+    bool valid = hit.hit;
+    for (iterator_type it = hit.stop; valid && !hit.full && it != last; ++it)
+    {
+        token_id id = token_id(*it);
+        if (id == T_NEWLINE || id == T_EOF || id == T_CPPCOMMENT)
+            break;
+        valid = (id == T_SPACE || id == T_SPACE2 || id == T_CCOMMENT);
+    }
+    if (!valid)
+    {
+        if (!if_block_status)
+            return false;
+        token_type::string_type expression =
+            util::impl::as_string<token_type::string_type>(first, last);
+        if (expression.empty())
+            expression = "<empty expression>";
+        BOOST_WAVE_THROW(preprocess_exception, ill_formed_expression,
+                         expression.c_str(), pos);
+        return false;
+    }
+
+    if (result.is_valid() != error_noerror)
+        status = result.is_valid();
+    return as_bool(result);
+}
+
+// The #if and #elif expressions of Wave are evaluated here, by the grammar
+// only if ExpressionEvaluator fails on them
+namespace boost { namespace wave { namespace grammars {
+
+template <>
+bool expression_grammar_gen<token_type>::evaluate(
+    token_sequence_type::const_iterator const& first,
+    token_sequence_type::const_iterator const& last,
+    token_type::position_type const& act_pos,
+    bool if_block_status, value_error& status)
+{
+    PhaseTimer::Scope phase(PhaseTimer::CONDITIONS);
+    std::vector<const token_type *> tokens;
+    std::string key;
+    for (token_sequence_type::const_iterator it = first; it != last; ++it)
+    {
+        token_id id = token_id(*it);
+        if (id == T_NEWLINE || id == T_EOF)
+            break;
+        if (id == T_SPACE || id == T_CCOMMENT || id == T_CPPCOMMENT)
+            continue;
+        tokens.push_back(&*it);
+        key += it->get_value().c_str();
+        key += '\n';
+    }
+
+    ExpressionCache& cache = ExpressionCache::instance();
+    bool value;
+    value_error cached_status;
+    if (!tokens.empty() && cache.find(key, value, cached_status))
+    {
+        if (cached_status != error_noerror)
+            status = cached_status;
+        return value;
+    }
+
+    closures::closure_value result;
+    if (!tokens.empty() && ExpressionEvaluator(tokens).evaluate(result))
+    {
+        value = as_bool(result);
+        if (result.is_valid() != error_noerror)
+            status = result.is_valid();
+        cache.store(key, value, result.is_valid());
+        return value;
+    }
+
+    cache.count_fallback();
+    return evaluate_by_grammar(first, last, act_pos, if_block_status, status);
+}
+
+}}} // namespace boost::wave::grammars
+
+// MacroStore --- the macros defined in a context, as told by the hooks, for
+// listing them without copying the definitions out of Wave. The names are
+// found by an open-addressing hash table. The parameters and the replacement
+// list of a macro are a run of indexes in one array, into the tokens of all
+// the definitions, each of which is kept once.
+class MacroStore
+{
+public:
+    // A token of the definitions, with its text in the buffer
+    struct TOKEN
+    {
+        boost::wave::token_id id;
+        unsigned int offset;
+        unsigned int length;
+    };
+
+    // A macro, whose run of tokens begins with its parameters
+    struct MACRO
+    {
+        unsigned int name;          // the offset of the name in the names
+        unsigned int name_length;
+        unsigned int first;         // the first of the run
+        unsigned int param_count;
+        unsigned int token_count;
+        FilePosition pos;
+        bool is_function;
+        bool is_predefined;
+        bool is_defined;            // false if undefined later
+    };
+
+    MacroStore() : m_used(0), m_removed(0)
+    {
+    }
+
+    template <typename TokenT, typename ParametersT, typename DefinitionT>
+    void define(const TokenT& name, bool is_function, const ParametersT& params,
+                const DefinitionT& definition, bool is_predefined)
+    {
+        const char *text = name.get_value().c_str();
+        size_t length = name.get_value().size();
+        undefine(text, length);
+
+        MACRO macro;
+        macro.name = (unsigned int)m_names.size();
+        macro.name_length = (unsigned int)length;
+        macro.first = (unsigned int)m_runs.size();
+        macro.param_count = 0;
+        macro.token_count = 0;
+        macro.pos = name.get_position();
+        macro.is_function = is_function;
+        macro.is_predefined = is_predefined;
+        macro.is_defined = true;
+        m_names.append(text, length);
+
+        typename ParametersT::const_iterator param, params_end = params.end();
+        for (param = params.begin(); param != params_end; ++param, ++macro.param_count)
+            m_runs.push_back(add_token(*param));
+        typename DefinitionT::const_iterator token, tokens_end = definition.end();
+        for (token = definition.begin(); token != tokens_end; ++token, ++macro.token_count)
+            m_runs.push_back(add_token(*token));
+
+        if ((m_used + 1) * 2 > m_slots.size())
+            rehash();
+        m_macros.push_back(macro);
+        insert((unsigned int)m_macros.size() - 1);
+    }
+
+    void undefine(const char *name, size_t length)
+    {
+        if (m_slots.empty())
+            return;
+
+        size_t slot = find_slot(name, length);
+        if (m_slots[slot] == EMPTY)
+            return;
+
+        m_macros[m_slots[slot] - 1].is_defined = false;
+        m_slots[slot] = REMOVED;
+        if (++m_removed > 4096 && m_removed * 2 > m_macros.size())
+            compact();
+    }
+
+    const MACRO *find(const char *name, size_t length) const
+    {
+        if (m_slots.empty())
+            return NULL;
+        unsigned int index = m_slots[find_slot(name, length)];
+        return (index == EMPTY) ? NULL : &m_macros[index - 1];
+    }
+
+    // Calls visitor(store, macro) for each macro, in the order of the names
+    template <typename VisitorT>
+    void visit(VisitorT& visitor) const
+    {
+        std::vector<unsigned int> order;
+        order.reserve(size());
+        for (unsigned int i = 0; i < m_macros.size(); ++i)
+        {
+            if (m_macros[i].is_defined)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), NameLess(*this));
+
+        for (size_t i = 0; i < order.size(); ++i)
+            visitor(*this, m_macros[order[i]]);
+    }
+
+    const char *name(const MACRO& macro) const
+    {
+        return m_names.data() + macro.name;
+    }
+    // The index-th token of the run of the macro
+    const TOKEN& token(const MACRO& macro, unsigned int index) const
+    {
+        return m_tokens[m_runs[macro.first + index]];
+    }
+    const char *text(const TOKEN& token) const
+    {
+        return m_text.data() + token.offset;
+    }
+
+    size_t size() const
+    {
+        return m_macros.size() - m_removed;
+    }
+    size_t bytes() const
+    {
+        return m_names.capacity() + m_macros.capacity() * sizeof(MACRO) +
+               m_slots.capacity() * sizeof(unsigned int) +
+               m_runs.capacity() * sizeof(unsigned int) + m_text.capacity() +
+               m_tokens.capacity() * sizeof(TOKEN) +
+               m_token_slots.capacity() * sizeof(unsigned int);
+    }
+
+protected:
+    enum { EMPTY = 0, REMOVED = ~0U };
+
+    std::string m_names;
+    std::vector<MACRO> m_macros;
+    std::vector<unsigned int> m_slots;  // the indexes of the macros plus one
+    size_t m_used;                      // the slots not empty
+    size_t m_removed;                   // the macros undefined
+    std::vector<unsigned int> m_runs;   // the indexes of the tokens
+
+    std::string m_text;
+    std::vector<TOKEN> m_tokens;
+    std::vector<unsigned int> m_token_slots;
+
+    struct NameLess
+    {
+        const MacroStore& m_store;
+        explicit NameLess(const MacroStore& store) : m_store(store)
+        {
+        }
+        bool operator()(unsigned int lhs, unsigned int rhs) const
+        {
+            const MACRO& a = m_store.m_macros[lhs];
+            const MACRO& b = m_store.m_macros[rhs];
+            int cmp = std::memcmp(m_store.name(a), m_store.name(b),
+                                  std::min(a.name_length, b.name_length));
+            return cmp < 0 || (cmp == 0 && a.name_length < b.name_length);
+        }
+    };
+
+    // The slot of the name, or the empty slot where it would be inserted
+    size_t find_slot(const char *name, size_t length) const
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t slot = (size_t)hash_bytes(name, length) & mask;
+        for (;;)
+        {
+            unsigned int index = m_slots[slot];
+            if (index == EMPTY)
+                return slot;
+            if (index != REMOVED)
+            {
+                const MACRO& macro = m_macros[index - 1];
+                if (macro.name_length == length &&
+                    std::memcmp(this->name(macro), name, length) == 0)
+                {
+                    return slot;
+                }
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    void insert(unsigned int index)
+    {
+        const MACRO& macro = m_macros[index];
+        size_t mask = m_slots.size() - 1;
+        size_t slot = (size_t)hash_bytes(name(macro), macro.name_length) & mask;
+        while (m_slots[slot] != EMPTY)
+            slot = (slot + 1) & mask;
+        m_slots[slot] = index + 1;
+        ++m_used;
+    }
+
+    // Makes the table at least four times as large as the macros defined
+    void rehash()
+    {
+        size_t capacity = 64;
+        while (capacity < (size() + 1) * 4)
+            capacity *= 2;
+
+        m_slots.assign(capacity, (unsigned int)EMPTY);
+        m_used = 0;
+        for (unsigned int i = 0; i < m_macros.size(); ++i)
+        {
+            if (m_macros[i].is_defined)
+                insert(i);
+        }
+    }
+
+    // Drops the names and the runs of the macros undefined
+    void compact()
+    {
+        std::string names;
+        std::vector<MACRO> macros;
+        std::vector<unsigned int> runs;
+        names.reserve(m_names.size());
+        macros.reserve(size());
+        runs.reserve(m_runs.size());
+
+        for (size_t i = 0; i < m_macros.size(); ++i)
+        {
+            const MACRO& old = m_macros[i];
+            if (!old.is_defined)
+                continue;
+
+            MACRO macro = old;
+            macro.name = (unsigned int)names.size();
+            names.append(name(old), old.name_length);
+            macro.first = (unsigned int)runs.size();
+            runs.insert(runs.end(), m_runs.begin() + old.first,
+                        m_runs.begin() + old.first + old.param_count +
+                        old.token_count);
+            macros.push_back(macro);
+        }
+
+        m_names.swap(names);
+        m_macros.swap(macros);
+        m_runs.swap(runs);
+        m_removed = 0;
+        rehash();
+    }
+
+    // The index of the token, added if new
+    template <typename TokenT>
+    unsigned int add_token(const TokenT& token)
+    {
+        boost::wave::token_id id = boost::wave::token_id(token);
+        const char *text = token.get_value().c_str();
+        size_t length = token.get_value().size();
+
+        if ((m_tokens.size() + 1) * 2 > m_token_slots.size())
+        {
+            m_token_slots.assign(std::max<size_t>(256, m_token_slots.size() * 2),
+                                 (unsigned int)EMPTY);
+            for (unsigned int i = 0; i < m_tokens.size(); ++i)
+                m_token_slots[find_token_slot(m_tokens[i].id, this->text(m_tokens[i]),
+                                              m_tokens[i].length)] = i + 1;
+        }
+
+        size_t slot = find_token_slot(id, text, length);
+        if (m_token_slots[slot] != EMPTY)
+            return m_token_slots[slot] - 1;
+
+        TOKEN item;
+        item.id = id;
+        item.offset = (unsigned int)m_text.size();
+        item.length = (unsigned int)length;
+        m_text.append(text, length);
+        m_tokens.push_back(item);
+        m_token_slots[slot] = (unsigned int)m_tokens.size();
+        return (unsigned int)m_tokens.size() - 1;
+    }
+
+    // The slot of the token, or the empty slot where it would be inserted
+    size_t find_token_slot(boost::wave::token_id id, const char *text,
+                           size_t length) const
+    {
+        size_t mask = m_token_slots.size() - 1;
+        size_t slot = (size_t)hash_bytes(text, length, HASH_SEED ^ id) & mask;
+        for (;;)
+        {
+            unsigned int index = m_token_slots[slot];
+            if (index == EMPTY)
+                return slot;
+            const TOKEN& token = m_tokens[index - 1];
+            if (token.id == id && token.length == length &&
+                std::memcmp(this->text(token), text, length) == 0)
+            {
+                return slot;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+};
+
+// ExpansionCache --- the full expansions of the object-like macros, reused
+// while the macros expanded and the names left in them are unchanged. The
+// hooks follow the nested expansions with a stack of frames, and a cached
+// expansion replaces the replacement list before Wave rescans it. Every name
+// kept has a version, bumped by #define and #undef.
+//
+// An expansion is not kept if it involves a function-like macro or a macro
+// built into Wave (__LINE__), differs inside #if (defined, __has_include),
+// has a side effect (_Pragma), or has met a macro under expansion.
+class ExpansionCache
+{
+public:
+    typedef token_type::string_type string_type;
+
+    ExpansionCache()
+        : m_enabled(true), m_depth(0), m_hits(0), m_chains(0), m_misses(0),
+          m_uncacheable(0), m_invalidated(0)
+    {
+    }
+
+    void set_enabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+
+    // #define or #undef of the name
+    void changed(const string_type& name)
+    {
+        std::map<string_type, unsigned int>::iterator it = m_versions.find(name);
+        if (it != m_versions.end())
+            ++it->second;
+    }
+
+    template <typename TokenT, typename ContainerT>
+    void expanding_object_like(const TokenT& macro, const ContainerT& definition)
+    {
+        if (!m_enabled)
+            return;
+
+        const string_type& name = macro.get_value();
+        FRAME& frame = push(&definition);
+        if (name == "__LINE__" || name == "__FILE__" || name == "__INCLUDE_LEVEL__")
+        {
+            frame.cacheable = false;    // the definition is a temporary
+            return;
+        }
+
+        typename std::map<const void *, ENTRY>::iterator it = m_entries.find(&definition);
+        if (it != m_entries.end())
+        {
+            if (is_valid(it->second))
+            {
+                ++m_hits;
+                if (it->second.nested)
+                    ++m_chains;
+                frame.entry = &it->second;
+                if (m_depth > 1)
+                    merge(m_frames[m_depth - 2], it->second.dependencies,
+                          it->second.chain);
+                return;
+            }
+            ++m_invalidated;
+            m_entries.erase(it);
+        }
+        ++m_misses;
+        frame.kept = true;
+
+        typename ContainerT::const_iterator token, end = definition.end();
+        for (token = definition.begin(); token != end; ++token)
+        {
+            const string_type& value = token->get_value();
+            if (value == "defined" || value == "__has_include" || value == "_Pragma")
+                frame.cacheable = false;
+        }
+        add_dependency(frame, name);
+    }
+
+    template <typename ContainerT>
+    void expanding_function_like(const ContainerT& definition)
+    {
+        if (!m_enabled)
+            return;
+
+        FRAME& frame = push(&definition);
+        frame.cacheable = false;
+    }
+
+    // Replaces the replacement list with the cached expansion
+    template <typename ContainerT>
+    void expanded(ContainerT& replacement_list)
+    {
+        if (!m_enabled || m_depth == 0)
+            return;
+
+        const ENTRY *entry = m_frames[m_depth - 1].entry;
+        if (entry && entry->nested)
+            replacement_list.assign(entry->expansion.begin(), entry->expansion.end());
+    }
+
+    template <typename ContainerT>
+    void rescanned(const ContainerT& result)
+    {
+        using namespace boost::wave;
+
+        if (!m_enabled || m_depth == 0)
+            return;
+
+        FRAME& frame = m_frames[--m_depth];
+        if (frame.entry)
+            return;     // merged into the parent already
+
+        typename ContainerT::const_iterator token, end = result.end();
+        for (token = result.begin(); frame.cacheable && token != end; ++token)
+        {
+            token_id id = token_id(*token);
+            if (id == T_NONREPLACABLE_IDENTIFIER)
+                frame.cacheable = false;
+            else if (id == T_IDENTIFIER || IS_CATEGORY(id, KeywordTokenType) ||
+                     IS_EXTCATEGORY(id, OperatorTokenType | AltExtTokenType) ||
+                     IS_CATEGORY(id, BoolLiteralTokenType))
+                add_dependency(frame, token->get_value());
+        }
+
+        if (frame.kept && frame.cacheable)
+        {
+            ENTRY& entry = m_entries[frame.key];
+            entry.dependencies = frame.dependencies;
+            entry.chain = frame.chain;
+            entry.nested = frame.nested;
+            entry.expansion.clear();
+            if (frame.nested &&
+                !(result.size() == 1 && token_id(result.front()) == T_PLACEHOLDER))
+            {
+                entry.expansion.assign(result.begin(), result.end());
+            }
+        }
+        else if (frame.kept)
+        {
+            ++m_uncacheable;
+        }
+
+        if (m_depth > 0)
+        {
+            FRAME& parent = m_frames[m_depth - 1];
+            if (frame.cacheable)
+                merge(parent, frame.dependencies, frame.chain);
+            else
+                parent.cacheable = false;
+        }
+    }
+
+    void print_stats(std::ostream& out) const
+    {
+        out << "expansion cache: " << m_hits << " hits (" << m_chains <<
+               " chains), " << m_misses << " misses, " << m_uncacheable <<
+               " not cacheable, " << m_invalidated << " out of date\n";
+    }
+
+protected:
+    // The version of a name when an expansion was kept
+    struct DEPENDENCY
+    {
+        const unsigned int *version;
+        unsigned int value;
+    };
+
+    struct ENTRY
+    {
+        std::vector<DEPENDENCY> dependencies;
+        std::vector<const void *> chain;    // the definitions expanded
+        bool nested;                        // other macros were expanded
+        token_sequence_type expansion;
+    };
+
+    struct FRAME
+    {
+        const void *key;                    // the definition
+        const ENTRY *entry;                 // the cached expansion used
+        bool kept;                          // to be kept if cacheable
+        bool cacheable;
+        bool nested;
+        std::vector<DEPENDENCY> dependencies;
+        std::vector<const void *> chain;
+    };
+
+    bool m_enabled;
+    std::map<string_type, unsigned int> m_versions;
+    std::map<const void *, ENTRY> m_entries;
+    std::vector<FRAME> m_frames;        // reused, m_depth of them in use
+    size_t m_depth;
+    unsigned long m_hits, m_chains, m_misses, m_uncacheable, m_invalidated;
+
+    FRAME& push(const void *key)
+    {
+        if (m_depth > 0)
+            m_frames[m_depth - 1].nested = true;
+        if (m_depth == m_frames.size())
+            m_frames.resize(m_depth + 1);
+
+        FRAME& frame = m_frames[m_depth++];
+        frame.key = key;
+        frame.entry = NULL;
+        frame.kept = false;
+        frame.cacheable = true;
+        frame.nested = false;
+        frame.dependencies.clear();
+        frame.chain.clear();
+        frame.chain.push_back(key);
+        return frame;
+    }
+
+    void add_dependency(FRAME& frame, const string_type& name)
+    {
+        DEPENDENCY dependency;
+        dependency.version = &m_versions[name];
+        dependency.value = *dependency.version;
+        frame.dependencies.push_back(dependency);
+    }
+
+    static void merge(FRAME& frame, const std::vector<DEPENDENCY>& dependencies,
+                      const std::vector<const void *>& chain)
+    {
+        frame.dependencies.insert(frame.dependencies.end(),
+                                  dependencies.begin(), dependencies.end());
+        frame.chain.insert(frame.chain.end(), chain.begin(), chain.end());
+    }
+
+    // Unchanged, and none of its macros is under expansion (a frame below)
+    bool is_valid(const ENTRY& entry) const
+    {
+        for (size_t i = 0; i < entry.dependencies.size(); ++i)
+        {
+            if (*entry.dependencies[i].version != entry.dependencies[i].value)
+                return false;
+        }
+        for (size_t i = 0; i + 1 < m_depth; ++i)
+        {
+            if (std::find(entry.chain.begin(), entry.chain.end(),
+                          m_frames[i].key) != entry.chain.end())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// MyContextPolicy --- the preprocessing hooks
+class MyContextPolicy
+    : public boost::wave::context_policies::eat_whitespace<token_type>
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string> > guards_type;
+
+    MyContextPolicy()
+        : m_directives_only(false), m_predefined_considered(PREDEFINED_COUNT),
+          m_adding_known_guard(false), m_output(NULL), m_line_base(LINES_FORCED),
+          m_line_offset(0), m_line_due_offset(std::string::npos),
+          m_token_offset(std::string::npos), m_newline_skipped(false),
+          m_line_pending(false), m_resumed(false), m_keep_macros(false)
+    {
+    }
+
+    // Whether each macro of predefined.h has been considered to be defined
+    std::vector<bool>& predefined_considered()
+    {
+        return m_predefined_considered;
+    }
+    const std::vector<bool>& predefined_considered() const
+    {
+        return m_predefined_considered;
+    }
+
+    // If true, the input policy passes only the directives of the files
+    bool directives_only() const
+    {
+        return m_directives_only;
+    }
+    void set_directives_only(bool directives_only)
+    {
+        m_directives_only = directives_only;
+    }
+
+    // The (file, guard macro) pairs of the headers not to be opened again
+    const guards_type& guards() const
+    {
+        return m_guards;
+    }
+
+    // The guards detected in the headers read by this run, without the ones
+    // known from a snapshot or the include database
+    const guards_type& detected_guards() const
+    {
+        return m_detected_guards;
+    }
+
+    // Makes a header known to be guarded not to be opened again
+    template <typename ContextT>
+    void add_known_guard(ContextT& ctx, const std::string& file,
+                         const std::string& guard)
+    {
+        m_adding_known_guard = true;
+        ctx.add_pragma_once_header(file, guard);
+        m_adding_known_guard = false;
+    }
+
+    // The files opened by #include, and the headers skipped by the guards
+    // of the include database, which the output depends on as well
+    const std::vector<std::string>& included_files() const
+    {
+        return m_included_files;
+    }
+    void set_included_files(const std::vector<std::string>& files)
+    {
+        m_included_files = files;
+    }
+
+    // The paths probed and not found before the headers of #include, which
+    // would be found instead if they were created
+    const std::set<std::string>& missing_files() const
+    {
+        return m_missing_files;
+    }
+
+    // The headers found by #include, once each, with the paths as found
+    // through the include paths. A header skipped by its guard is included.
+    const std::vector<std::string>& dependencies() const
+    {
+        return m_dependencies;
+    }
+
+    // Called with the line of each #include of the input. While it is set,
+    // the names of the macros defined or undefined are collected.
+    typedef boost::function<void (unsigned int)> checkpoint_handler;
+    void set_checkpoint_handler(const checkpoint_handler& handler)
+    {
+        m_checkpoint_handler = handler;
+    }
+    void take_changed_macros(std::set<std::string>& names)
+    {
+        names.clear();
+        names.swap(m_changed_macros);
+    }
+
+    // The macros defined since set_keep_macros(true), which should be
+    // called before the language is set
+    const MacroStore& macros() const
+    {
+        return m_macros;
+    }
+    void set_keep_macros(bool keep)
+    {
+        m_keep_macros = keep;
+    }
+
+    ExpansionCache& expansion_cache()
+    {
+        return m_expansion_cache;
+    }
+
+    // Makes Wave write a #line directive before the next token, as if
+    // newlines had been skipped. Used when resuming in the middle.
+    void set_line_pending()
+    {
+        m_line_pending = true;
+    }
+
+    // Follows the lines of the input Wave writes into the output, which is
+    // kept in the string, for the checkpoints (see lines_written)
+    void follow_lines(const std::string& output)
+    {
+        m_output = &output;
+        m_line_base = (unsigned int)-1;
+        m_line_offset = output.size();
+        m_line_due_offset = std::string::npos;
+        m_token_offset = std::string::npos;
+        m_newline_skipped = false;
+    }
+
+    // The lines of the input written so far as the iterator of Wave counts
+    // them from its last #line directive, which decides the next one. After
+    // a header, it writes one next anyway: LINES_FORCED.
+    static const unsigned int LINES_FORCED = (unsigned int)-2;
+    unsigned int lines_written() const
+    {
+        if (m_line_base == LINES_FORCED)
+            return LINES_FORCED;
+        return m_line_base + (unsigned int)std::count(
+            m_output->begin() + m_line_offset, m_output->end(), '\n');
+    }
+
+    // Whether Wave writes a #line directive before the next token of the
+    // input whatever the lines, as after the directives it parses by its
+    // grammar
+    bool line_due() const
+    {
+        return m_line_base == LINES_FORCED || m_line_due_offset == m_output->size();
+    }
+
+    // Whether newlines have been skipped since the last #line directive or
+    // newline written for one, which makes Wave consider another at the
+    // start of each line
+    bool newline_skipped() const
+    {
+        return m_newline_skipped;
+    }
+
+    // Continues the lines of a run resumed in the middle. The new iterator
+    // of Wave has counted none: its next #line directive of the input is
+    // left out or written as a newline the same way as it would have been.
+    void resume_lines(unsigned int lines_written, bool line_due, bool newline_skipped)
+    {
+        m_line_base = lines_written;
+        m_line_offset = m_output->size();
+        m_line_due_offset = line_due ? m_output->size() : std::string::npos;
+        m_token_offset = std::string::npos;
+        m_newline_skipped = newline_skipped;
+        m_line_pending = line_due || newline_skipped;
+        m_resumed = (lines_written != LINES_FORCED);
+    }
+
+    template <typename ContextT, typename ContainerT>
+    bool emit_line_directive(ContextT const& ctx, ContainerT& pending,
+                             typename ContextT::token_type const& act_token)
+    {
+        if (!m_output || ctx.get_iteration_depth() != 0)
+            return false;
+
+        // Wave has counted the line before it, and counts the newline next
+        unsigned int line = ctx.get_main_pos().get_line() + 1;
+        unsigned int lines = lines_written();
+        bool due = line_due();
+        m_line_base = line - 2;
+        m_line_offset = m_output->size();
+        m_line_due_offset = std::string::npos;
+        if (!m_resumed)
+            return false;
+
+        m_resumed = false;
+        if (lines + 1 == line && !due)
+        {
+            // none, and the newlines skipped are still accounted for
+            pending.push_back(typename ContextT::token_type(
+                boost::wave::T_GENERATEDNEWLINE, "", act_token.get_position()));
+            m_line_base = line - 1;
+            m_line_pending = true;
+            return true;
+        }
+        if (lines + 2 == line && line != 1)
+        {
+            pending.push_back(typename ContextT::token_type(
+                boost::wave::T_GENERATEDNEWLINE, "\n", act_token.get_position()));
+            return true;
+        }
+        return false;
+    }
+
+    template <typename ContextT, typename TokenT>
+    bool may_skip_whitespace(ContextT const& ctx, TokenT& token,
+                             bool& skipped_newline)
+    {
+        // Called again for the token passed last when Wave has written a
+        // #line directive or a newline for it
+        bool line_written = false;
+        if (m_output)
+        {
+            line_written = (m_token_offset == m_output->size());
+            if (line_written)
+                m_newline_skipped = false;
+            m_token_offset = std::string::npos;
+        }
+
+        if (m_line_pending)
+        {
+            m_line_pending = false;
+            skipped_newline = true;
+        }
+        bool skip = eat_whitespace<token_type>::may_skip_whitespace(ctx, token,
+                                                                    skipped_newline);
+        if (m_output)
+        {
+            if (skipped_newline)
+                m_newline_skipped = true;
+            if (!skip && !line_written)
+                m_token_offset = m_output->size();
+        }
+        return skip;
+    }
+
+    // Called for each include path added to the context
+    void add_search_path(const boost::filesystem::path& complete_path,
+                         const std::string& path, bool is_system)
+    {
+        SEARCH_PATHS::list_type& list =
+            is_system ? m_search_paths.system : m_search_paths.user;
+        list.push_back(std::make_pair(complete_path, path));
+
+        m_search_paths.key += is_system ? "S" : "I";
+        m_search_paths.key += complete_path.string();
+        m_search_paths.key += '\n';
+    }
+
+    template <typename ContextT>
+    bool locate_include_file(ContextT& ctx, std::string& file_path,
+                             bool is_system, char const *current_name,
+                             std::string& dir_path, std::string& native_name)
+    {
+        IncludeResolver::RESULT result;
+        if (!IncludeResolver::instance().resolve(m_search_paths,
+                                                 ctx.get_current_directory(),
+                                                 file_path, is_system,
+                                                 current_name, result))
+        {
+            return false;
+        }
+
+        if (result.in_current_dir)
+        {
+            using namespace boost::wave::util;
+            boost::filesystem::path dir =
+                branch_path(create_path(ctx.get_current_relative_filename()));
+            dir_path = (dir / create_path(file_path)).string();
+        }
+        else
+        {
+            dir_path = result.dir;
+        }
+        file_path = result.path;
+        native_name = result.path;
+        m_missing_files.insert(result.missing.begin(), result.missing.end());
+
+        if (m_dependency_set.insert(result.path).second)
+            m_dependencies.push_back(dir_path);
+
+        // A guarded header of the previous runs, guarded already
+        IncludeDatabase& database = IncludeDatabase::instance();
+        std::string guard;
+        if (database.enabled() && database.find_guard(result.path, guard) &&
+            ctx.is_defined_macro(guard) && !ctx.has_pragma_once(result.path))
+        {
+            add_known_guard(ctx, result.path, guard);
+            m_included_files.push_back(result.path);
+            database.add_skipped();
+        }
+        if (ctx.has_pragma_once(result.path))
+        {
+            PhaseTimer::count(PhaseTimer::GUARD_SKIPS);
+            if (IncludeProfiler *profiler = IncludeProfiler::current())
+                profiler->skipped(result.path);
+        }
+        return true;
+    }
+
+    template <typename ContextT, typename TokenT>
+    bool found_directive(ContextT const& ctx, TokenT const& directive)
+    {
+        using namespace boost::wave;
+        PhaseTimer::enter(PhaseTimer::DIRECTIVES);
+        if (m_checkpoint_handler && ctx.get_iteration_depth() == 0)
+        {
+            switch (token_id(directive))
+            {
+            case T_PP_INCLUDE: case T_PP_QHEADER: case T_PP_HHEADER:
+            case T_PP_INCLUDE_NEXT: case T_PP_QHEADER_NEXT: case T_PP_HHEADER_NEXT:
+                m_checkpoint_handler(directive.get_position().get_line());
+                break;
+            default:
+                break;
+            }
+        }
+        if (m_output && ctx.get_iteration_depth() == 0)
+        {
+            // The directives handled without the grammar are followed by no
+            // #line directive, unless newlines are skipped
+            switch (token_id(directive))
+            {
+            case T_PP_QHEADER: case T_PP_HHEADER:
+            case T_PP_QHEADER_NEXT: case T_PP_HHEADER_NEXT:
+            case T_PP_IFDEF: case T_PP_IFNDEF: case T_PP_ELSE: case T_PP_ENDIF:
+            case T_PP_UNDEF:
+                break;
+            default:
+                m_line_due_offset = m_output->size();
+                break;
+            }
+        }
+        return false;
+    }
+
+    template <typename ContextT>
+    void opened_include_file(ContextT const& ctx, std::string const& relname,
+                             std::string const& absname, bool is_system_include)
+    {
+        m_included_files.push_back(absname);
+        if (IncludeProfiler *profiler = IncludeProfiler::current())
+            profiler->opened(absname);
+    }
+
+    template <typename ContextT>
+    void returning_from_include_file(ContextT const& ctx)
+    {
+        if (ctx.get_iteration_depth() == 1)
+        {
+            m_line_base = LINES_FORCED;
+            m_resumed = false;
+        }
+        if (IncludeProfiler *profiler = IncludeProfiler::current())
+            profiler->returning();
+    }
+
+    template <typename ContextT>
+    void detected_include_guard(ContextT const& ctx, std::string const& filename,
+                                std::string const& include_guard)
+    {
+        m_guards.push_back(std::make_pair(filename, include_guard));
+        if (!m_adding_known_guard)
+            m_detected_guards.push_back(m_guards.back());
+    }
+
+    template <typename ContextT, typename TokenT>
+    void detected_pragma_once(ContextT const& ctx, TokenT const& pragma_token,
+                              std::string const& filename)
+    {
+        m_guards.push_back(std::make_pair(filename,
+                                          std::string("__BOOST_WAVE_PRAGMA_ONCE__")));
+        m_detected_guards.push_back(m_guards.back());
+    }
+
+    template <typename ContextT, typename TokenT, typename ParametersT,
+              typename DefinitionT>
+    void defined_macro(ContextT const& ctx, TokenT const& macro_name,
+                       bool is_functionlike, ParametersT const& parameters,
+                       DefinitionT const& definition, bool is_predefined)
+    {
+        PhaseTimer::count(PhaseTimer::MACROS_DEFINED);
+        if (m_checkpoint_handler)
+            m_changed_macros.insert(macro_name.get_value().c_str());
+        if (m_keep_macros)
+        {
+            m_macros.define(macro_name, is_functionlike, parameters, definition,
+                            is_predefined);
+        }
+        m_expansion_cache.changed(macro_name.get_value());
+    }
+
+    // Wave forgets a guard when its macro is undefined
+    template <typename ContextT, typename TokenT>
+    void undefined_macro(ContextT const& ctx, TokenT const& macro_name)
+    {
+        std::string name = macro_name.get_value().c_str();
+        if (m_checkpoint_handler)
+            m_changed_macros.insert(name);
+        if (m_keep_macros)
+            m_macros.undefine(name.c_str(), name.size());
+        m_expansion_cache.changed(macro_name.get_value());
+        for (size_t i = m_guards.size(); i-- > 0; )
+        {
+            if (m_guards[i].second == name)
+                m_guards.erase(m_guards.begin() + i);
+        }
+    }
+
+    // The expansions are followed by the ExpansionCache, the PhaseTimer and
+    // the MacroProfiler
+    template <typename ContextT, typename TokenT, typename ContainerT,
+              typename IteratorT>
+    bool expanding_function_like_macro(
+        ContextT const& ctx, TokenT const& macrodef,
+        std::vector<TokenT> const& formal_args, ContainerT const& definition,
+        TokenT const& macrocall, std::vector<ContainerT> const& arguments,
+        IteratorT const& seqstart, IteratorT const& seqend)
+    {
+        // __VA_OPT__ is not rescanned on its own
+        if (macrodef.get_value() != "__VA_OPT__")
+        {
+            m_expansion_cache.expanding_function_like(definition);
+            begin_expansion(macrodef);
+        }
+        return false;
+    }
+
+    template <typename ContextT, typename TokenT, typename ContainerT>
+    bool expanding_object_like_macro(ContextT const& ctx, TokenT const& macro,
+                                     ContainerT const& definition,
+                                     TokenT const& macrocall)
+    {
+        m_expansion_cache.expanding_object_like(macro, definition);
+        begin_expansion(macro);
+        return false;
+    }
+
+    // The replacement list is Wave's own, to be rescanned next. A predefined
+    // macro named by ## is defined before the rescan.
+    template <typename ContextT, typename ContainerT>
+    void expanded_macro(ContextT const& ctx, ContainerT const& result)
+    {
+        using namespace boost::wave;
+        typename ContainerT::const_iterator it, end = result.end();
+        for (it = result.begin(); it != end; ++it)
+        {
+            if (IS_CATEGORY(token_id(*it), IdentifierTokenType))
+            {
+                const typename ContainerT::value_type::string_type& name =
+                    it->get_value();
+                add_used_predefined_macro(const_cast<ContextT&>(ctx),
+                                          name.c_str(), name.size());
+            }
+        }
+        m_expansion_cache.expanded(const_cast<ContainerT&>(result));
+    }
+
+    template <typename ContextT, typename ContainerT>
+    void rescanned_macro(ContextT const& ctx, ContainerT const& result)
+    {
+        m_expansion_cache.rescanned(result);
+        end_expansion(result);
+    }
+
+protected:
+    bool m_directives_only;
+    std::vector<bool> m_predefined_considered;
+    guards_type m_guards;
+    guards_type m_detected_guards;
+    bool m_adding_known_guard;
+    std::vector<std::string> m_included_files;
+    std::set<std::string> m_missing_files;
+    std::vector<std::string> m_dependencies;
+    std::set<std::string> m_dependency_set;
+    SEARCH_PATHS m_search_paths;
+    checkpoint_handler m_checkpoint_handler;
+    std::set<std::string> m_changed_macros;
+    const std::string *m_output;
+    unsigned int m_line_base;       // lines_written at m_line_offset
+    size_t m_line_offset;
+    size_t m_line_due_offset;       // the output size at a directive parsed
+    size_t m_token_offset;          // the output size at a token passed
+    bool m_newline_skipped;
+    bool m_line_pending;
+    bool m_resumed;                 // until the next #line of the input
+    bool m_keep_macros;
+    MacroStore m_macros;
+    ExpansionCache m_expansion_cache;
+
+    template <typename TokenT>
+    static void begin_expansion(TokenT const& macro)
+    {
+        if (PhaseTimer *timer = PhaseTimer::current())
+        {
+            timer->add(PhaseTimer::MACROS_EXPANDED);
+            timer->begin_expansion();
+        }
+        if (MacroProfiler *profiler = MacroProfiler::current())
+            profiler->expanding(macro.get_value().c_str());
+    }
+
+    template <typename ContainerT>
+    static void end_expansion(ContainerT const& result)
+    {
+        using namespace boost::wave;
+        if (MacroProfiler *profiler = MacroProfiler::current())
+        {
+            unsigned long long tokens = 0;
+            typename ContainerT::const_iterator it, end = result.end();
+            for (it = result.begin(); it != end; ++it)
+            {
+                token_id id = token_id(*it);
+                if (!IS_CATEGORY(id, WhiteSpaceTokenType) && id != T_PLACEMARKER)
+                    ++tokens;
+            }
+            profiler->rescanned(tokens);
+        }
+        if (PhaseTimer *timer = PhaseTimer::current())
+            timer->end_expansion();
+    }
+};
+
+typedef boost::wave::context<const char *, TokenIterator, MyInputPolicy,
+                             MyContextPolicy> WaveContext;
+
+std::string get_position_str(const typename token_type::position_type& pos)
+{
+    std::string str = pos.get_file().c_str();
+    std::replace(str.begin(), str.end(), '\\', '/');
+
+    char line[32];
+    std::sprintf(line, ":%u", (unsigned int)pos.get_line());
+    str += line;
+    return str;
+}
+
+// MacroPrinter --- writes each macro of a MacroStore as a #define line
+template <class CharT, class Traits>
+class MacroPrinter
+{
+public:
+    explicit MacroPrinter(std::basic_ostream<CharT, Traits>& out) : m_out(out)
+    {
+    }
+
+    void operator()(const MacroStore& store, const MacroStore::MACRO& macro)
+    {
+        if (macro.is_predefined)
+            return;
+
+        m_out << get_position_str(macro.pos) << ": #define ";
+        m_out.write(store.name(macro), macro.name_length);
+        if (macro.is_function)
+        {
+            m_out << "(";
+            for (unsigned int i = 0; i < macro.param_count; ++i)
+            {
+                if (i > 0)
+                    m_out << ",";
+                write(store, store.token(macro, i));
+            }
+            m_out << ")";
+        }
+        m_out << " ";
+        for (unsigned int i = 0; i < macro.token_count; ++i)
+        {
+            write(store, store.token(macro, macro.param_count + i));
+        }
+        m_out << "\n";
+    }
+
+protected:
+    std::basic_ostream<CharT, Traits>& m_out;
+
+    void write(const MacroStore& store, const MacroStore::TOKEN& token)
+    {
+        m_out.write(store.text(token), token.length);
+    }
+};
+
+// The macros must have been kept by the hooks (see set_keep_macros)
+template <class CharT, class Traits>
+void print_definitions(WaveContext& context, std::basic_ostream<CharT, Traits>& out)
+{
+    MacroPrinter<CharT, Traits> printer(out);
+    context.get_hooks().macros().visit(printer);
+}
+
+// OutputSink --- collects the output into large blocks and writes them
+// at once. With the writer thread, a block is written while the next one
+// is being filled.
+class OutputSink : private boost::noncopyable
+{
+public:
+    static const size_t BLOCK_SIZE = 256 * 1024;
+
+    OutputSink()
+        : m_stream(NULL), m_file(INVALID_FILE), m_failed(false),
+          m_has_pending(false), m_closing(false)
+    {
+        m_block.reserve(BLOCK_SIZE);
+    }
+
+    ~OutputSink()
+    {
+        close();
+    }
+
+    bool open(const std::string& file)
+    {
+#ifdef _WIN32
+        // Text mode, as std::ofstream
+        m_file = fopen(file.c_str(), "w");
+#else
+        m_file = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+        return m_file != INVALID_FILE;
+    }
+
+    void open(std::streambuf *stream)
+    {
+        m_stream = stream;
+    }
+
+    void start_thread()
+    {
+        m_pending.reserve(BLOCK_SIZE);
+        m_thread.reset(new boost::thread(&OutputSink::writer_thread, this));
+    }
+
+    void write(const char *data, size_t size)
+    {
+        if (m_block.size() + size > BLOCK_SIZE)
+            flush_block();
+        m_block.append(data, size);
+    }
+    void write(const std::string& str)
+    {
+        write(str.c_str(), str.size());
+    }
+
+    // Returns false if failed to write
+    bool close()
+    {
+        flush_block();
+
+        if (m_thread)
+        {
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_closing = true;
+                m_cond.notify_all();
+            }
+            m_thread->join();
+            m_thread.reset();
+        }
+
+        if (m_stream)
+        {
+            if (m_stream->pubsync() == -1)
+                m_failed = true;
+            m_stream = NULL;
+        }
+        if (m_file != INVALID_FILE)
+        {
+#ifdef _WIN32
+            if (fclose(m_file) != 0)
+                m_failed = true;
+#else
+            if (::close(m_file) != 0)
+                m_failed = true;
+#endif
+            m_file = INVALID_FILE;
+        }
+        return !m_failed;
+    }
+
+protected:
+#ifdef _WIN32
+    typedef FILE *file_type;
+    static const file_type INVALID_FILE;
+#else
+    typedef int file_type;
+    static const file_type INVALID_FILE = -1;
+#endif
+    std::streambuf *m_stream;
+    file_type m_file;
+    bool m_failed;
+    std::string m_block;                // being filled
+    std::string m_pending;              // being written by the thread
+    boost::scoped_ptr<boost::thread> m_thread;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_has_pending;
+    bool m_closing;
+
+    void flush_block()
+    {
+        if (m_block.empty())
+            return;
+
+        PhaseTimer::Scope phase(PhaseTimer::OUTPUT);
+        if (!m_thread)
+        {
+            write_out(m_block.c_str(), m_block.size());
+            m_block.clear();
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        while (m_has_pending)
+            m_cond.wait(lock);
+        m_pending.swap(m_block);
+        m_has_pending = true;
+        m_cond.notify_all();
+    }
+
+    void writer_thread()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        for (;;)
+        {
+            while (!m_has_pending && !m_closing)
+                m_cond.wait(lock);
+            if (!m_has_pending)
+                break;
+
+            lock.unlock();
+            write_out(m_pending.c_str(), m_pending.size());
+            m_pending.clear();
+            lock.lock();
+
+            m_has_pending = false;
+            m_cond.notify_all();
+        }
+    }
+
+    void write_out(const char *data, size_t size)
+    {
+        if (m_stream)
+        {
+            if (m_stream->sputn(data, size) != std::streamsize(size))
+                m_failed = true;
+            return;
+        }
+
+#ifdef _WIN32
+        if (fwrite(data, 1, size, m_file) != size)
+            m_failed = true;
+#else
+        while (size > 0)
+        {
+            ssize_t written = ::write(m_file, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                m_failed = true;
+                return;
+            }
+            data += written;
+            size -= written;
+        }
+#endif
+    }
+};
+
+#ifdef _WIN32
+    const OutputSink::file_type OutputSink::INVALID_FILE = NULL;
+#endif
+
+// OPTIONS --- the options parsed from the command line
+struct OPTIONS
+{
+    int argc;
+    char **argv;
+    std::string language;
+    bool emit_definitions;
+    bool emit_stats;
+    size_t jobs;                    // the number of worker threads
+    bool warm;                      // keep the setup between runs (server)
+    std::string snapshot_file;      // the snapshot to load (--snapshot)
+    std::string save_snapshot_file; // the snapshot to save (--snapshot-save)
+    bool output_thread;             // write the output on a thread
+    bool expansion_cache;           // reuse the expansions of the macros
+    bool time_report;               // time the phases (--time-report)
+    std::string time_report_file;   // the JSON report (--time-report-json)
+    bool macro_profile;             // profile the macros
+    std::string macro_profile_file; // the table (--macro-profile)
+    std::string macro_stacks_file;  // the folded stacks (--macro-stacks)
+    bool include_graph;             // profile the includes
+    std::string include_graph_file; // the JSON graph (--include-graph)
+    std::string include_dot_file;   // the Graphviz graph (--include-graph-dot)
+    bool macros_only;               // process the directives only (implies -dM)
+    bool dependencies_only;         // process the directives only (-M)
+    bool emit_dependencies;         // -M or -MD
+    std::string dependency_target;  // the target of the rule (-MT)
+    std::string include_db_file;    // the include database (--include-db)
+    std::string incremental_file;   // the checkpoints (--incremental)
+    std::string cache_dir;          // the output cache (--cache)
+    unsigned long long cache_size;  // the limit of the output cache
+};
+
+// JOB --- a file to be preprocessed
+struct JOB
+{
+    std::string input_file;
+    std::string output_file;        // empty for stdout
+    std::string macro_output_file;  // empty for stdout
+    std::string dependency_file;    // empty for stdout
+};
+
+typedef MacroSnapshot<WaveContext> WaveSnapshot;
+
+static const char SNAPSHOT_SIGNATURE[] = "MZCPP-SNAPSHOT-1";
+
+// Hashes the options and the environment which affect a snapshot
+hash_type get_options_hash(const OPTIONS& options)
+{
+    hash_type hash = hash_string(SNAPSHOT_SIGNATURE);
+    hash = hash_bytes(BOOST_LIB_VERSION, sizeof(BOOST_LIB_VERSION), hash);
+    hash_type table_hash = PredefinedIndex::instance().hash();
+    hash = hash_bytes(&table_hash, sizeof(table_hash), hash);
+    hash = hash_string(options.language, hash);
+
+    for (int i = 1; i < options.argc; ++i)
+    {
+        const char *arg = options.argv[i];
+        if (arg[0] != '-')
+            continue;
+
+        switch (arg[1])
+        {
+        case 'D': case 'U':
+            hash = hash_string(arg, hash);
+            break;
+        case 'I': case 'S':
+            // The paths of the headers depend on the include paths
+            hash = hash_bytes(arg, 2, hash);
+            hash = hash_string(boost::filesystem::absolute(arg + 2).string(), hash);
+            break;
+        }
+    }
+
+    static const char * const env_names[] =
+    {
+        "INCLUDE", "MINGW_PREFIX", "MINGW_CHOST",
+        "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH"
+    };
+    for (size_t i = 0; i < sizeof(env_names) / sizeof(env_names[0]); ++i)
+    {
+        const char *value = getenv(env_names[i]);
+        hash = hash_string(value ? value : "", hash);
+    }
+
+    return hash;
+}
+
+// Writes the snapshot of a prefix header, with the hashes of the files
+// which contributed to it
+bool save_snapshot_file(const OPTIONS& options, WaveContext& context,
+                        const std::string& main_file, const std::string& output)
+{
+    WaveSnapshot snapshot;
+    snapshot.save(context);
+    snapshot.set_output(output);
+
+    // Like a precompiled header, the prefix header itself is not included again
+    using namespace boost::wave::util;
+    boost::filesystem::path path =
+        complete_path(create_path(get_wave_path(main_file)));
+    path = normalize(path);
+    snapshot.add_guard(native_file_string(path), "__MZCPP_SNAPSHOT__");
+
+    std::vector<std::string> files = context.get_hooks().included_files();
+    files.insert(files.begin(), main_file);
+    std::sort(files.begin() + 1, files.end());
+    files.erase(std::unique(files.begin() + 1, files.end()), files.end());
+
+    BinaryWriter writer;
+    writer.put_string(std::string(SNAPSHOT_SIGNATURE));
+    writer.put_u64(get_options_hash(options));
+    writer.put_u32((unsigned int)files.size());
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        SourceCache::buffer_ptr code = SourceCache::instance().load(files[i].c_str());
+        if (!code)
+            return false;
+        writer.put_string(files[i]);
+        writer.put_u64(hash_bytes(code->begin(), code->size()));
+    }
+    snapshot.write(writer);
+
+    std::ofstream fout(options.save_snapshot_file.c_str(), std::ios::binary);
+    fout.write(writer.data().c_str(), writer.data().size());
+    return fout.good();
+}
+
+// Loads the snapshot file of the options, unless it is out of date
+bool load_snapshot_file(const OPTIONS& options, WaveSnapshot& snapshot,
+                        std::ostream& err)
+{
+    std::ifstream fin(options.snapshot_file.c_str(), std::ios::binary);
+    if (!fin.is_open())
+    {
+        err << "WARNING: cannot open snapshot '" << options.snapshot_file << "'\n";
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(fin)),
+                     std::istreambuf_iterator<char>());
+
+    BinaryReader reader(data.c_str(), data.c_str() + data.size());
+    std::string signature;
+    hash_type options_hash;
+    unsigned int num_files;
+    if (!reader.get_string(signature) || signature != SNAPSHOT_SIGNATURE ||
+        !reader.get_u64(options_hash) || !reader.get_u32(num_files))
+    {
+        err << "WARNING: invalid snapshot '" << options.snapshot_file << "'\n";
+        return false;
+    }
+
+    if (options_hash != get_options_hash(options))
+    {
+        err << "WARNING: snapshot '" << options.snapshot_file <<
+               "' was made with other options; ignored\n";
+        return false;
+    }
+
+    for (unsigned int i = 0; i < num_files; ++i)
+    {
+        std::string file;
+        hash_type hash;
+        if (!reader.get_string(file) || !reader.get_u64(hash))
+        {
+            err << "WARNING: invalid snapshot '" << options.snapshot_file << "'\n";
+            return false;
+        }
+
+        SourceCache::buffer_ptr code = SourceCache::instance().load(file.c_str());
+        if (!code || hash_bytes(code->begin(), code->size()) != hash)
+        {
+            err << "WARNING: snapshot '" << options.snapshot_file <<
+                   "' is out of date ('" << file << "' changed); ignored\n";
+            return false;
+        }
+    }
+
+    if (!snapshot.read(reader) || !reader.at_end())
+    {
+        err << "WARNING: invalid snapshot '" << options.snapshot_file << "'\n";
+        return false;
+    }
+    return true;
+}
+
+static const char OUTPUT_CACHE_SIGNATURE[] = "MZCPP-CACHE-2";
+
+// OutputCache --- the outputs of the previous runs (--cache), like ccache.
+// The output of an input with the same options is kept in a manifest file
+// with the hashes of the files included, and the paths probed before them.
+// The first result whose files are unchanged and whose probes still fail is
+// used. The least recently used files are removed when the
+// cache gets larger than the limit.
+class OutputCache : private boost::noncopyable
+{
+public:
+    struct RESULT
+    {
+        std::string output;     // unless --macros-only
+        std::string macros;     // for -dM
+    };
+
+    static OutputCache& instance()
+    {
+        static OutputCache s_cache;
+        return s_cache;
+    }
+
+    bool enabled() const
+    {
+        return !m_dir.empty();
+    }
+
+    // Disables the cache and forgets the counters
+    void reset()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_dir.clear();
+        m_hits = m_misses = m_stores = m_uncacheable = m_evictions = 0;
+    }
+
+    void open(const std::string& dir, unsigned long long max_size)
+    {
+        reset();
+        m_dir = dir;
+        m_max_size = max_size;
+    }
+
+    // Writes the counters of this run and trims the cache
+    void close()
+    {
+        if (!enabled())
+            return;
+
+        if (m_stores)
+            evict();
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        unsigned long long counters[NUM_COUNTERS];
+        read_counters(counters);
+        counters[0] += m_hits;
+        counters[1] += m_misses;
+        counters[2] += m_stores;
+        counters[3] += m_evictions;
+        write_counters(counters);
+    }
+
+    bool find(hash_type key, RESULT& result)
+    {
+        std::vector<ENTRY> entries;
+        std::string path = get_path(key);
+        if (read_manifest(path, key, entries))
+        {
+            for (size_t i = 0; i < entries.size(); ++i)
+            {
+                if (!is_unchanged(entries[i].files) || !are_missing(entries[i].missing))
+                    continue;
+
+                // Recently used
+                boost::system::error_code ec;
+                boost::filesystem::last_write_time(path, std::time(NULL), ec);
+
+                result = entries[i].result;
+                boost::mutex::scoped_lock lock(m_mutex);
+                ++m_hits;
+                return true;
+            }
+        }
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_misses;
+        return false;
+    }
+
+    // Stores the result of the files of a run started at the time, unless it
+    // depends on the time. A file modified since the second before the run
+    // may have been read before, or be modified again with the same
+    // identity, so the result isn't stored either.
+    void store(hash_type key, const std::vector<std::string>& files,
+               const std::set<std::string>& missing, std::time_t started,
+               const RESULT& result)
+    {
+        ENTRY entry;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            FILE_RECORD record;
+            std::string canonical;
+            SourceCache::buffer_ptr code = SourceCache::instance().load(files[i].c_str());
+            if (!code || !SourceCache::get_file_id(files[i].c_str(), canonical, record.id))
+                return;
+            boost::system::error_code ec;
+            std::time_t modified = boost::filesystem::last_write_time(files[i], ec);
+            if (ec || modified >= started - 1 ||
+                depends_on_time(code->begin(), code->end()))
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                ++m_uncacheable;
+                return;
+            }
+            record.path = files[i];
+            record.hash = hash_bytes(code->begin(), code->size());
+            entry.files.push_back(record);
+        }
+        entry.missing.assign(missing.begin(), missing.end());
+        entry.result = result;
+
+        // The new entry comes first
+        std::string path = get_path(key);
+        std::vector<ENTRY> entries;
+        read_manifest(path, key, entries);
+        entries.insert(entries.begin(), entry);
+        if (entries.size() > MAX_ENTRIES)
+            entries.resize(MAX_ENTRIES);
+
+        BinaryWriter writer;
+        writer.put_string(std::string(OUTPUT_CACHE_SIGNATURE));
+        writer.put_u64(key);
+        writer.put_u32((unsigned int)entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const ENTRY& e = entries[i];
+            writer.put_u32((unsigned int)e.files.size());
+            for (size_t k = 0; k < e.files.size(); ++k)
+            {
+                const FILE_RECORD& record = e.files[k];
+                writer.put_string(record.path);
+                writer.put_u64(record.id.dev);
+                writer.put_u64(record.id.ino);
+                writer.put_u64(record.id.size);
+                writer.put_u64(record.id.mtime);
+                writer.put_u64(record.hash);
+            }
+            writer.put_u32((unsigned int)e.missing.size());
+            for (size_t k = 0; k < e.missing.size(); ++k)
+                writer.put_string(e.missing[k]);
+            writer.put_string(e.result.output);
+            writer.put_string(e.result.macros);
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(
+            boost::filesystem::path(path).parent_path(), ec);
+        if (write_file(path, writer.data()))
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            ++m_stores;
+        }
+    }
+
+    // Prints the counters of this run (--stats)
+    void print_stats(std::ostream& out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out << "output cache: " << m_hits << " hits, " << m_misses <<
+               " misses, " << m_stores << " stored, " << m_uncacheable <<
+               " uncacheable\n";
+    }
+
+    // Prints the counters of all the runs and the size (--cache-stats)
+    void print_total_stats(std::ostream& out)
+    {
+        unsigned long long files, size;
+        get_size(files, size, NULL);
+        unsigned long long counters[NUM_COUNTERS];
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            read_counters(counters);
+        }
+
+        out << "cache directory: " << m_dir << "\n" <<
+               "files:           " << files << "\n" <<
+               "size:            " << size << " bytes (max " << m_max_size << ")\n" <<
+               "hits:            " << counters[0] << "\n" <<
+               "misses:          " << counters[1] << "\n" <<
+               "stored:          " << counters[2] << "\n" <<
+               "evicted:         " << counters[3] << std::endl;
+    }
+
+    // Removes all the results and the counters (--cache-clear)
+    bool clear()
+    {
+        std::vector<std::string> paths;
+        unsigned long long files, size;
+        get_size(files, size, &paths);
+
+        boost::system::error_code ec;
+        bool ok = true;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (!boost::filesystem::remove(paths[i], ec))
+                ok = false;
+        }
+        boost::filesystem::remove(get_stats_path(), ec);
+        return ok;
+    }
+
+protected:
+    enum { NUM_COUNTERS = 4, MAX_ENTRIES = 4 };
+
+    struct FILE_RECORD
+    {
+        std::string path;
+        SourceCache::FILE_ID id;
+        hash_type hash;
+    };
+
+    struct ENTRY
+    {
+        std::vector<FILE_RECORD> files;
+        std::vector<std::string> missing;
+        RESULT result;
+    };
+
+    boost::mutex m_mutex;
+    std::string m_dir;
+    unsigned long long m_max_size;
+    size_t m_hits, m_misses, m_stores, m_uncacheable, m_evictions;
+
+    OutputCache()
+        : m_max_size(0), m_hits(0), m_misses(0), m_stores(0), m_uncacheable(0),
+          m_evictions(0)
+    {
+    }
+
+    // <dir>/<2 digits>/<14 digits>.mzc
+    std::string get_path(hash_type key) const
+    {
+        char hex[17];
+        std::sprintf(hex, "%016llx", key);
+        boost::filesystem::path path(m_dir);
+        path /= std::string(hex, 2);
+        path /= std::string(hex + 2) + ".mzc";
+        return path.string();
+    }
+
+    std::string get_stats_path() const
+    {
+        return (boost::filesystem::path(m_dir) / "stats").string();
+    }
+
+    // Writes a file at once, for the other processes
+    static bool write_file(const std::string& path, const std::string& data)
+    {
+        namespace fs = boost::filesystem;
+        boost::system::error_code ec;
+        fs::path temp = fs::path(path).parent_path() / fs::unique_path("%%%%%%%%.tmp", ec);
+        if (ec)
+            return false;
+        {
+            std::ofstream fout(temp.string().c_str(), std::ios::binary);
+            fout.write(data.c_str(), data.size());
+            if (!fout.good())
+                return false;
+        }
+        fs::rename(temp, path, ec);
+        if (ec)
+        {
+            fs::remove(temp, ec);
+            return false;
+        }
+        return true;
+    }
+
+    static bool read_manifest(const std::string& path, hash_type key,
+                              std::vector<ENTRY>& entries)
+    {
+        std::ifstream fin(path.c_str(), std::ios::binary);
+        if (!fin.is_open())
+            return false;
+        std::string data((std::istreambuf_iterator<char>(fin)),
+                         std::istreambuf_iterator<char>());
+
+        BinaryReader reader(data.c_str(), data.c_str() + data.size());
+        std::string signature;
+        hash_type stored_key;
+        unsigned int count;
+        if (!reader.get_string(signature) || signature != OUTPUT_CACHE_SIGNATURE ||
+            !reader.get_u64(stored_key) || stored_key != key ||
+            !reader.get_u32(count))
+        {
+            return false;
+        }
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            ENTRY entry;
+            unsigned int num_files;
+            if (!reader.get_u32(num_files))
+                return false;
+            for (unsigned int k = 0; k < num_files; ++k)
+            {
+                FILE_RECORD record;
+                if (!reader.get_string(record.path) || !reader.get_u64(record.id.dev) ||
+                    !reader.get_u64(record.id.ino) || !reader.get_u64(record.id.size) ||
+                    !reader.get_u64(record.id.mtime) || !reader.get_u64(record.hash))
+                {
+                    return false;
+                }
+                entry.files.push_back(record);
+            }
+            unsigned int num_missing;
+            if (!reader.get_u32(num_missing))
+                return false;
+            for (unsigned int k = 0; k < num_missing; ++k)
+            {
+                std::string path;
+                if (!reader.get_string(path))
+                    return false;
+                entry.missing.push_back(path);
+            }
+            if (!reader.get_string(entry.result.output) ||
+                !reader.get_string(entry.result.macros))
+            {
+                return false;
+            }
+            entries.push_back(entry);
+        }
+        return reader.at_end();
+    }
+
+    // Whether the files have the same identities or contents
+    static bool is_unchanged(const std::vector<FILE_RECORD>& files)
+    {
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            const FILE_RECORD& record = files[i];
+            std::string canonical;
+            SourceCache::FILE_ID id;
+            if (!SourceCache::get_file_id(record.path.c_str(), canonical, id))
+                return false;
+            if (id == record.id)
+                continue;
+
+            SourceCache::buffer_ptr code =
+                SourceCache::instance().load(record.path.c_str());
+            if (!code || hash_bytes(code->begin(), code->size()) != record.hash)
+                return false;
+        }
+        return true;
+    }
+
+    // Whether the paths are still not found
+    static bool are_missing(const std::vector<std::string>& paths)
+    {
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            boost::system::error_code ec;
+            if (boost::filesystem::exists(paths[i], ec))
+                return false;
+        }
+        return true;
+    }
+
+    // Whether the text may use __DATE__, __TIME__ or __TIMESTAMP__
+    static bool depends_on_time(const char *first, const char *last)
+    {
+        static const char * const names[] =
+        {
+            "__DATE__", "__TIME__", "__TIMESTAMP__"
+        };
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        {
+            const char *name = names[i];
+            if (std::search(first, last, name, name + std::strlen(name)) != last)
+                return true;
+        }
+        return false;
+    }
+
+    // Counts the results, collecting their paths if paths is non-NULL
+    void get_size(unsigned long long& files, unsigned long long& size,
+                  std::vector<std::string> *paths) const
+    {
+        namespace fs = boost::filesystem;
+        files = size = 0;
+
+        boost::system::error_code ec;
+        fs::recursive_directory_iterator it(m_dir, ec), end;
+        for (; !ec && it != end; it.increment(ec))
+        {
+            if (it->path().extension() != ".mzc")
+                continue;
+            ++files;
+            size += fs::file_size(it->path(), ec);
+            if (paths)
+                paths->push_back(it->path().string());
+        }
+    }
+
+    // Removes the least recently used results until 90% of the limit
+    void evict()
+    {
+        namespace fs = boost::filesystem;
+        std::vector<std::pair<std::time_t, std::pair<std::string, unsigned long long> > > items;
+        unsigned long long total = 0;
+
+        boost::system::error_code ec;
+        fs::recursive_directory_iterator it(m_dir, ec), end;
+        for (; !ec && it != end; it.increment(ec))
+        {
+            if (it->path().extension() != ".mzc")
+                continue;
+            boost::system::error_code ec2;
+            unsigned long long size = fs::file_size(it->path(), ec2);
+            std::time_t time = fs::last_write_time(it->path(), ec2);
+            total += size;
+            items.push_back(std::make_pair(time, std::make_pair(it->path().string(), size)));
+        }
+        if (total <= m_max_size)
+            return;
+
+        std::sort(items.begin(), items.end());
+        unsigned long long goal = m_max_size / 10 * 9;
+        for (size_t i = 0; i < items.size() && total > goal; ++i)
+        {
+            if (fs::remove(items[i].second.first, ec))
+            {
+                total -= items[i].second.second;
+                boost::mutex::scoped_lock lock(m_mutex);
+                ++m_evictions;
+            }
+        }
+    }
+
+    // The counters of all the runs: hits, misses, stored and evicted.
+    // Concurrent processes may lose some counts.
+    void read_counters(unsigned long long counters[NUM_COUNTERS]) const
+    {
+        for (int i = 0; i < NUM_COUNTERS; ++i)
+            counters[i] = 0;
+
+        std::ifstream fin(get_stats_path().c_str());
+        for (int i = 0; i < NUM_COUNTERS && (fin >> counters[i]); ++i)
+            ;
+    }
+    void write_counters(const unsigned long long counters[NUM_COUNTERS]) const
+    {
+        std::ostringstream oss;
+        for (int i = 0; i < NUM_COUNTERS; ++i)
+            oss << counters[i] << "\n";
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(m_dir, ec);
+        write_file(get_stats_path(), oss.str());
+    }
+};
+
+// The key of the output cache for the input and the options
+hash_type get_cache_key(const OPTIONS& options, const JOB& job,
+                        const SourceBuffer& code)
+{
+    hash_type hash = hash_string(OUTPUT_CACHE_SIGNATURE);
+
+    // Another build may write another output
+    hash = hash_string(__DATE__ " " __TIME__, hash);
+
+    hash_type options_hash = get_options_hash(options);
+    hash = hash_bytes(&options_hash, sizeof(options_hash), hash);
+    hash = hash_bytes(&options.emit_definitions, sizeof(options.emit_definitions), hash);
+    hash = hash_bytes(&options.macros_only, sizeof(options.macros_only), hash);
+
+    // __FILE__ is the path as given, #line is the complete path
+    hash = hash_string(job.input_file, hash);
+    hash = hash_string(boost::filesystem::absolute(job.input_file).string(), hash);
+    return hash_bytes(code.begin(), code.size(), hash);
+}
+
+static const char INCREMENTAL_SIGNATURE[] = "MZCPP-INCREMENTAL-2";
+
+// IncrementalState --- the checkpoints of the previous run (--incremental).
+// A checkpoint is the state before a top-level #include of the input: the
+// macros, the guards, the output and the files included so far. A run
+// resumes from the last checkpoint before the first change of the files.
+class IncrementalState : private boost::noncopyable
+{
+public:
+    struct CHECKPOINT
+    {
+        unsigned int line;          // the line of the #include
+        size_t offset;              // the offset of the line in the input
+        size_t output_size;         // the size of the output so far
+        size_t num_files;           // the number of the files included so far
+        hash_type hash;             // the hash of the input before the line
+        unsigned int lines;         // see MyContextPolicy::lines_written
+        bool line_due;              // see MyContextPolicy::line_due
+        bool newline_skipped;       // see MyContextPolicy::newline_skipped
+
+        // The macros changed since the previous checkpoint, and the guards
+        boost::shared_ptr<WaveSnapshot> changes;
+        std::vector<std::string> removed;
+    };
+
+    IncrementalState(const char *first, const char *last)
+        : m_first(first), m_last(last), m_skip_line(0), m_stride(1),
+          m_boundaries(0), m_hashed(0), m_hash(HASH_SEED)
+    {
+        find_top_level_includes(first, last, m_includes);
+    }
+
+    // Loads the state of the previous run and keeps the checkpoints still
+    // valid. Returns true if the run can resume from the last of them.
+    bool load(const OPTIONS& options, const JOB& job, std::ostream& err)
+    {
+        std::ifstream fin(options.incremental_file.c_str(), std::ios::binary);
+        if (!fin.is_open())
+            return false;   // the first run
+        std::string data((std::istreambuf_iterator<char>(fin)),
+                         std::istreambuf_iterator<char>());
+
+        BinaryReader reader(data.c_str(), data.c_str() + data.size());
+        std::string signature, input;
+        hash_type options_hash;
+        unsigned int num_files, num_checkpoints;
+        if (!reader.get_string(signature) || signature != INCREMENTAL_SIGNATURE ||
+            !reader.get_u64(options_hash) || !reader.get_string(input) ||
+            !reader.get_u32(num_files))
+        {
+            err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+            return false;
+        }
+        if (options_hash != get_options_hash(options) ||
+            input != boost::filesystem::absolute(job.input_file).string())
+        {
+            return false;   // another input or options
+        }
+
+        // The files before the first change
+        std::vector<std::string> files;
+        bool changed = false;
+        for (unsigned int i = 0; i < num_files; ++i)
+        {
+            std::string path;
+            SourceCache::FILE_ID id;
+            hash_type hash;
+            if (!reader.get_string(path) || !reader.get_u64(id.dev) ||
+                !reader.get_u64(id.ino) || !reader.get_u64(id.size) ||
+                !reader.get_u64(id.mtime) || !reader.get_u64(hash))
+            {
+                err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+                return false;
+            }
+            if (!changed && is_unchanged(path, id, hash))
+                files.push_back(path);
+            else
+                changed = true;
+        }
+
+        // The checkpoints before it, in the unchanged part of the input
+        std::vector<CHECKPOINT> checkpoints;
+        size_t hashed = 0;
+        hash_type hash = HASH_SEED;
+        if (!reader.get_u32(num_checkpoints))
+        {
+            err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+            return false;
+        }
+        for (unsigned int i = 0; i < num_checkpoints; ++i)
+        {
+            CHECKPOINT checkpoint;
+            unsigned long long offset, output_size;
+            unsigned int num_files_before, num_removed;
+            unsigned char line_due, newline_skipped;
+            checkpoint.changes.reset(new WaveSnapshot);
+            if (!reader.get_u32(checkpoint.line) || !reader.get_u64(offset) ||
+                !reader.get_u64(output_size) || !reader.get_u32(num_files_before) ||
+                !reader.get_u64(checkpoint.hash) || !reader.get_u32(checkpoint.lines) ||
+                !reader.get_u8(line_due) || !reader.get_u8(newline_skipped) ||
+                !checkpoint.changes->read(reader) ||
+                !reader.get_u32(num_removed))
+            {
+                err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+                return false;
+            }
+            checkpoint.removed.resize(num_removed);
+            for (unsigned int k = 0; k < num_removed; ++k)
+            {
+                if (!reader.get_string(checkpoint.removed[k]))
+                {
+                    err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+                    return false;
+                }
+            }
+            checkpoint.offset = (size_t)offset;
+            checkpoint.output_size = (size_t)output_size;
+            checkpoint.line_due = (line_due != 0);
+            checkpoint.newline_skipped = (newline_skipped != 0);
+            checkpoint.num_files = num_files_before;
+
+            if (checkpoints.size() < i || checkpoint.num_files > files.size() ||
+                checkpoint.offset < hashed || checkpoint.offset > size_t(m_last - m_first))
+            {
+                continue;   // after a change
+            }
+            hash = hash_bytes(m_first + hashed, checkpoint.offset - hashed, hash);
+            hashed = checkpoint.offset;
+            if (hash == checkpoint.hash)
+                checkpoints.push_back(checkpoint);
+        }
+
+        std::string output;
+        if (!reader.get_string(output) || !reader.at_end())
+        {
+            err << "WARNING: invalid state '" << options.incremental_file << "'\n";
+            return false;
+        }
+        while (!checkpoints.empty() && checkpoints.back().output_size > output.size())
+            checkpoints.pop_back();
+        if (checkpoints.empty())
+            return false;
+
+        // The state at the last checkpoint is the sum of the changes
+        for (size_t i = 0; i < checkpoints.size(); ++i)
+            m_snapshot.apply(*checkpoints[i].changes, checkpoints[i].removed);
+
+        const CHECKPOINT& resume = checkpoints.back();
+        m_resume = resume;
+        m_output.assign(output, 0, resume.output_size);
+        m_files.assign(files.begin(), files.begin() + resume.num_files);
+        m_skip_line = resume.line;
+        m_checkpoints.swap(checkpoints);
+        return true;
+    }
+
+    // The checkpoint to resume from, with its macros, and the output and
+    // the files before it
+    const CHECKPOINT& resume_point() const
+    {
+        return m_resume;
+    }
+    const WaveSnapshot& snapshot() const
+    {
+        return m_snapshot;
+    }
+    const std::string& output() const
+    {
+        return m_output;
+    }
+    const std::vector<std::string>& files() const
+    {
+        return m_files;
+    }
+
+    // Takes a checkpoint before the #include at the line, if outside #if.
+    // When there are too many, every other one is merged into the next one
+    // and fewer are taken.
+    void record(WaveContext& context, unsigned int line, const std::string& output)
+    {
+        if (line == m_skip_line)
+        {
+            m_skip_line = 0;    // resumed from it
+            return;
+        }
+
+        std::map<unsigned int, size_t>::const_iterator it = m_includes.find(line);
+        if (it == m_includes.end() || m_boundaries++ % m_stride != 0)
+            return;
+
+        size_t offset = it->second;
+        if (offset < m_hashed)
+        {
+            m_hashed = 0;
+            m_hash = HASH_SEED;
+        }
+        m_hash = hash_bytes(m_first + m_hashed, offset - m_hashed, m_hash);
+        m_hashed = offset;
+
+        CHECKPOINT checkpoint;
+        checkpoint.line = line;
+        checkpoint.offset = offset;
+        checkpoint.output_size = output.size();
+        checkpoint.num_files = context.get_hooks().included_files().size();
+        checkpoint.hash = m_hash;
+        checkpoint.lines = context.get_hooks().lines_written();
+        checkpoint.line_due = context.get_hooks().line_due();
+        checkpoint.newline_skipped = context.get_hooks().newline_skipped();
+
+        std::set<std::string> names;
+        context.get_hooks().take_changed_macros(names);
+        checkpoint.changes.reset(new WaveSnapshot);
+        if (m_checkpoints.empty())
+            checkpoint.changes->save(context);
+        else
+            checkpoint.changes->save(context, names, checkpoint.removed);
+        m_checkpoints.push_back(checkpoint);
+
+        if (m_checkpoints.size() > MAX_CHECKPOINTS)
+        {
+            size_t kept = 1;
+            for (size_t i = 2; i < m_checkpoints.size(); i += 2)
+            {
+                merge(m_checkpoints[i - 1], m_checkpoints[i]);
+                std::swap(m_checkpoints[kept++], m_checkpoints[i]);
+            }
+            m_checkpoints.resize(kept);
+            m_stride *= 2;
+        }
+    }
+
+    bool save(const OPTIONS& options, const JOB& job, WaveContext& context,
+              const std::string& output) const
+    {
+        BinaryWriter writer;
+        writer.put_string(std::string(INCREMENTAL_SIGNATURE));
+        writer.put_u64(get_options_hash(options));
+        writer.put_string(boost::filesystem::absolute(job.input_file).string());
+
+        const std::vector<std::string>& files = context.get_hooks().included_files();
+        writer.put_u32((unsigned int)files.size());
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            std::string canonical;
+            SourceCache::FILE_ID id;
+            SourceCache::buffer_ptr code = SourceCache::instance().load(files[i].c_str());
+            if (!code || !SourceCache::get_file_id(files[i].c_str(), canonical, id))
+                return false;
+            writer.put_string(files[i]);
+            writer.put_u64(id.dev);
+            writer.put_u64(id.ino);
+            writer.put_u64(id.size);
+            writer.put_u64(id.mtime);
+            writer.put_u64(hash_bytes(code->begin(), code->size()));
+        }
+
+        writer.put_u32((unsigned int)m_checkpoints.size());
+        for (size_t i = 0; i < m_checkpoints.size(); ++i)
+        {
+            const CHECKPOINT& checkpoint = m_checkpoints[i];
+            writer.put_u32(checkpoint.line);
+            writer.put_u64(checkpoint.offset);
+            writer.put_u64(checkpoint.output_size);
+            writer.put_u32((unsigned int)checkpoint.num_files);
+            writer.put_u64(checkpoint.hash);
+            writer.put_u32(checkpoint.lines);
+            writer.put_u8(checkpoint.line_due);
+            writer.put_u8(checkpoint.newline_skipped);
+            checkpoint.changes->write(writer);
+            writer.put_u32((unsigned int)checkpoint.removed.size());
+            for (size_t k = 0; k < checkpoint.removed.size(); ++k)
+                writer.put_string(checkpoint.removed[k]);
+        }
+        writer.put_string(output);
+
+        std::ofstream fout(options.incremental_file.c_str(), std::ios::binary);
+        fout.write(writer.data().c_str(), writer.data().size());
+        return fout.good();
+    }
+
+    size_t checkpoints() const
+    {
+        return m_checkpoints.size();
+    }
+
+protected:
+    enum { MAX_CHECKPOINTS = 64 };
+
+    const char *m_first;
+    const char *m_last;
+    CHECKPOINT m_resume;
+    WaveSnapshot m_snapshot;
+    std::string m_output;
+    std::vector<std::string> m_files;
+    std::vector<CHECKPOINT> m_checkpoints;
+    unsigned int m_skip_line;
+    size_t m_stride, m_boundaries;
+    std::map<unsigned int, size_t> m_includes;  // the #include lines outside #if
+    size_t m_hashed;                // the size of the input hashed
+    hash_type m_hash;
+
+    // Makes the changes of the next checkpoint include the ones of the former
+    static void merge(const CHECKPOINT& former, CHECKPOINT& next)
+    {
+        boost::shared_ptr<WaveSnapshot> changes(new WaveSnapshot(*former.changes));
+        changes->apply(*next.changes, next.removed);
+        next.changes = changes;
+
+        std::vector<std::string> removed = former.removed;
+        removed.insert(removed.end(), next.removed.begin(), next.removed.end());
+        next.removed.swap(removed);
+    }
+
+    static bool is_unchanged(const std::string& path, const SourceCache::FILE_ID& id,
+                             hash_type hash)
+    {
+        std::string canonical;
+        SourceCache::FILE_ID current;
+        if (!SourceCache::get_file_id(path.c_str(), canonical, current))
+            return false;
+        if (current == id)
+            return true;
+
+        SourceCache::buffer_ptr code = SourceCache::instance().load(path.c_str());
+        return code && hash_bytes(code->begin(), code->size()) == hash;
+    }
+};
+
+// Writes a result of the output cache, the same way as preprocess
+int write_cached_result(const OPTIONS& options, const JOB& job,
+                        const OutputCache::RESULT& result, std::ostream& err)
+{
+    if (!options.macros_only)
+    {
+        OutputSink out;
+        if (job.output_file.empty())
+        {
+            out.open(std::cout.rdbuf());
+        }
+        else if (!out.open(job.output_file))
+        {
+            err << "ERROR: cannot open file '" << job.output_file << "'\n";
+            return EXITCODE_CANTOPENFILE;
+        }
+        out.write(result.output);
+        if (!out.close())
+        {
+            err << "ERROR: cannot write file '" <<
+                   (job.output_file.empty() ? "(stdout)" : job.output_file) << "'\n";
+            return EXITCODE_CANTOPENFILE;
+        }
+    }
+
+    if (options.emit_definitions)
+    {
+        if (job.macro_output_file.empty())
+        {
+            std::cout << result.macros;
+        }
+        else
+        {
+            std::ofstream fout(job.macro_output_file);
+            if (!fout.is_open())
+            {
+                err << "ERROR: cannot open file '" << job.macro_output_file << "'\n";
+                return EXITCODE_CANTOPENFILE;
+            }
+            fout << result.macros;
+        }
+    }
+    return EXITCODE_SUCCESS;
+}
+
+// Escapes a file name for a rule of make
+std::string escape_make_path(const std::string& path)
+{
+    std::string ret;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        char ch = path[i];
+        if (ch == ' ' || ch == '\t' || ch == '#')
+            ret += '\\';
+        else if (ch == '$')
+            ret += '$';
+        ret += ch;
+    }
+    return ret;
+}
+
+// The default dependency file of -MD: the output with the .d extension,
+// or the input without the directory if written to stdout, as gcc does
+std::string get_dependency_file(const JOB& job)
+{
+    boost::filesystem::path path(job.output_file);
+    if (job.output_file.empty())
+        path = boost::filesystem::path(job.input_file).filename();
+    return path.replace_extension(".d").string();
+}
+
+// Writes the files included by the input as a rule of make (-M, -MD)
+int write_dependencies(const OPTIONS& options, const JOB& job,
+                       const std::vector<std::string>& dependencies,
+                       std::ostream& err)
+{
+    std::string target = options.dependency_target;
+    if (target.empty())
+    {
+        boost::filesystem::path path =
+            boost::filesystem::path(job.input_file).filename();
+        target = escape_make_path(path.replace_extension(".o").string());
+    }
+
+    std::string rule = target + ": " + escape_make_path(job.input_file);
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        rule += " \\\n  ";
+        rule += escape_make_path(dependencies[i]);
+    }
+    rule += "\n";
+
+    if (job.dependency_file.empty())
+    {
+        std::cout << rule;
+        return EXITCODE_SUCCESS;
+    }
+
+    std::ofstream fout(job.dependency_file);
+    fout << rule;
+    if (!fout.good())
+    {
+        err << "ERROR: cannot write file '" << job.dependency_file << "'\n";
+        return EXITCODE_CANTOPENFILE;
+    }
+    return EXITCODE_SUCCESS;
+}
+
+int preprocess(const OPTIONS& options, const JOB& job, std::ostream& err,
+               const WaveSnapshot *snapshot = NULL)
+{
+    // The phases, the macros and the includes of this run, if reported
+    PhaseTimer phase_timer(options.time_report);
+    MacroProfiler macro_profiler(options.macro_profile);
+    IncludeProfiler include_profiler(options.include_graph);
+    std::time_t started = std::time(NULL);
+
+    // Load source
+    phase_timer.switch_to(PhaseTimer::READING);
+    SourceCache::buffer_ptr code =
+        SourceCache::instance().load(job.input_file.c_str());
+    phase_timer.switch_to(PhaseTimer::OTHER);
+    if (!code)
+    {
+        err << "ERROR: cannot open file '" << job.input_file << "'\n";
+        return EXITCODE_CANTOPENFILE;
+    }
+    phase_timer.add(PhaseTimer::FILES_OPENED);
+    phase_timer.add(PhaseTimer::BYTES_READ, code->size());
+
+    // The output of a previous run, if the files are unchanged.
+    // The output of a snapshot depends on more files.
+    OutputCache& cache = OutputCache::instance();
+    bool use_cache = cache.enabled() && options.snapshot_file.empty() &&
+                     options.save_snapshot_file.empty() &&
+                     !options.emit_dependencies;
+    hash_type cache_key = 0;
+    OutputCache::RESULT result;
+    if (use_cache)
+    {
+        cache_key = get_cache_key(options, job, *code);
+        if (cache.find(cache_key, result))
+        {
+            phase_timer.switch_to(PhaseTimer::OUTPUT);
+            return write_cached_result(options, job, result, err);
+        }
+    }
+    if (options.include_graph)
+    {
+        include_profiler.start(boost::filesystem::absolute(job.input_file).string(),
+                               code->size());
+    }
+
+    // Only the directives matter for the macros and the dependencies
+    bool directives_only = options.macros_only || options.dependencies_only;
+    const char *first = code->begin(), *last = code->end();
+    boost::shared_ptr<const std::string> directives;
+    if (directives_only)
+    {
+        directives = get_directives(*code);
+        first = directives->c_str();
+        last = first + directives->size();
+    }
+
+    // Resume from the last checkpoint before the first change
+    boost::scoped_ptr<IncrementalState> incremental;
+    bool resume = false;
+    if (!options.incremental_file.empty())
+    {
+        incremental.reset(new IncrementalState(first, last));
+        resume = incremental->load(options, job, err);
+        if (resume)
+        {
+            first += incremental->resume_point().offset;
+            snapshot = &incremental->snapshot();
+        }
+    }
+
+    // Prepare context, with its tokens in an arena of its own
+    TokenArena::Scope arena_scope;
+    WaveContext context(first, last, get_wave_path(job.input_file).c_str());
+    context.get_hooks().set_directives_only(directives_only);
+    context.get_hooks().set_keep_macros(options.emit_definitions);
+    context.get_hooks().expansion_cache().set_enabled(options.expansion_cache);
+
+    if (!setup_context(context, options.argc, options.argv, options.language,
+                       snapshot))
+    {
+        return EXITCODE_INVALIDARG;
+    }
+    if (resume)
+        context.get_hooks().set_included_files(incremental->files());
+
+    // The checkpoints are taken while iterating, with the lines written
+    std::string& captured = result.output;
+    if (incremental)
+    {
+        context.get_hooks().set_checkpoint_handler(
+            boost::bind(&IncrementalState::record, incremental.get(),
+                        boost::ref(context), _1, boost::cref(captured)));
+        context.get_hooks().follow_lines(captured);
+    }
+    add_used_predefined_macros(context, first, last);
+
+    // The lexers skip the false #if blocks of the context
+    IfBlockStatus if_block_status(context);
+
+    try
+    {
+        if (directives_only)
+        {
+            // The directives are processed while iterating
+            phase_timer.switch_to(PhaseTimer::LEXING);
+            WaveContext::iterator_type it, end = context.end();
+            for (it = context.begin(); it != end; ++it)
+                phase_timer.switch_to(PhaseTimer::LEXING);
+            phase_timer.switch_to(PhaseTimer::OTHER);
+        }
+        else
+        {
+            OutputSink out;
+            if (job.output_file.empty())
+            {
+                out.open(std::cout.rdbuf());
+            }
+            else if (!out.open(job.output_file))
+            {
+                err << "ERROR: cannot open file '" << job.output_file << "'\n";
+                return EXITCODE_CANTOPENFILE;
+            }
+            if (options.output_thread)
+                out.start_thread();
+
+            // The output of the prefix header in the snapshot comes first
+            if (snapshot && !snapshot->output().empty())
+            {
+                out.write(snapshot->output());
+
+                // Back to the input, at the line of its first token
+                context.get_hooks().set_line_pending();
+            }
+
+            // The output is kept if a snapshot is to be saved or cached
+            bool capture = !options.save_snapshot_file.empty() || use_cache ||
+                           incremental;
+
+            WaveContext::iterator_type it, end = context.end();
+            if (resume)
+            {
+                // The output before the checkpoint is the same
+                out.write(incremental->output());
+                captured = incremental->output();
+
+                // The lines continue from the checkpoint
+                using namespace boost::wave::util;
+                boost::filesystem::path path =
+                    complete_path(create_path(get_wave_path(job.input_file)));
+                const IncrementalState::CHECKPOINT& point = incremental->resume_point();
+                unsigned int line = point.line;
+                context.get_hooks().resume_lines(point.lines, point.line_due,
+                                                 point.newline_skipped);
+                WaveContext::position_type pos(path.string().c_str(), line, 1);
+                it = WaveContext::iterator_type(context, first, last, pos);
+            }
+            else
+            {
+                phase_timer.switch_to(PhaseTimer::LEXING);
+                it = context.begin();
+            }
+            for (phase_timer.switch_to(PhaseTimer::LEXING); it != end; ++it)
+            {
+                // The blocks of the output are timed when written
+                phase_timer.switch_to(PhaseTimer::LEXING);
+                phase_timer.add(PhaseTimer::TOKENS_EMITTED);
+                include_profiler.add_token();
+                const WaveContext::string_type& value = it->get_value();
+                out.write(value.c_str(), value.size());
+                if (capture)
+                    captured.append(value.c_str(), value.size());
+            }
+
+            phase_timer.switch_to(PhaseTimer::OUTPUT);
+            if (!out.close())
+            {
+                err << "ERROR: cannot write file '" <<
+                       (job.output_file.empty() ? "(stdout)" : job.output_file) << "'\n";
+                return EXITCODE_CANTOPENFILE;
+            }
+            phase_timer.switch_to(PhaseTimer::OTHER);
+
+            if (!options.save_snapshot_file.empty() &&
+                !save_snapshot_file(options, context,
+                                    boost::filesystem::absolute(job.input_file).string(),
+                                    captured))
+            {
+                err << "ERROR: cannot save snapshot '" <<
+                       options.save_snapshot_file << "'\n";
+                return EXITCODE_CANTOPENFILE;
+            }
+        }
+
+        if (IncludeDatabase::instance().enabled())
+            IncludeDatabase::instance().add_guards(context.get_hooks().detected_guards());
+
+        if (options.emit_dependencies)
+        {
+            int ret = write_dependencies(options, job,
+                                         context.get_hooks().dependencies(), err);
+            if (ret != EXITCODE_SUCCESS)
+                return ret;
+        }
+
+        if (options.emit_definitions)
+        {
+            std::ofstream fout;
+            if (!job.macro_output_file.empty())
+            {
+                fout.open(job.macro_output_file);
+                if (!fout.is_open())
+                {
+                    err << "ERROR: cannot open file '" << job.macro_output_file << "'\n";
+                    return EXITCODE_CANTOPENFILE;
+                }
+            }
+            std::ostream& out = job.macro_output_file.empty() ? std::cout : fout;
+
+            PhaseTimer::Scope phase(PhaseTimer::DEFINITIONS);
+            if (use_cache)
+            {
+                std::ostringstream macros;
+                print_definitions(context, macros);
+                result.macros = macros.str();
+                out << result.macros;
+            }
+            else
+            {
+                print_definitions(context, out);
+            }
+
+            if (options.emit_stats)
+            {
+                const MacroStore& store = context.get_hooks().macros();
+                err << "macro store: " << store.size() << " macros, " <<
+                       store.bytes() << " bytes\n";
+            }
+        }
+
+        if (incremental &&
+            !incremental->save(options, job, context, result.output))
+        {
+            err << "WARNING: cannot save state '" << options.incremental_file << "'\n";
+        }
+        if (options.emit_stats)
+            context.get_hooks().expansion_cache().print_stats(err);
+        if (incremental && options.emit_stats)
+        {
+            err << "incremental: ";
+            if (resume)
+                err << "resumed at line " << incremental->resume_point().line;
+            else
+                err << "from the beginning";
+            err << ", " << incremental->checkpoints() << " checkpoints\n";
+        }
+
+        // A resumed run has not probed the paths before the checkpoint
+        if (use_cache && !resume)
+        {
+            std::vector<std::string> files = context.get_hooks().included_files();
+            files.insert(files.begin(), job.input_file);
+            cache.store(cache_key, files, context.get_hooks().missing_files(),
+                        started, result);
+        }
+    }
+    catch (const boost::wave::cpp_exception& ex)
+    {
+        err << ex.file_name() << ":" << ex.line_no() << ": " <<
+                     ex.description() << std::endl;
+        return EXITCODE_FAILPROCESS;
+    }
+
+    return EXITCODE_SUCCESS;
+}
+
+// Reads the 'input [output [macro-output]]' lines of a batch list
+bool load_batch_list(const std::string& list_file, std::vector<JOB>& jobs)
+{
+    std::ifstream fin(list_file);
+    if (!fin.is_open())
+        return false;
+
+    std::string line;
+    while (std::getline(fin, line))
+    {
+        std::istringstream iss(line);
+        JOB job;
+        if (!(iss >> job.input_file) || job.input_file[0] == '#')
+            continue;   // empty line or comment
+
+        iss >> job.output_file >> job.macro_output_file;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+const char *get_exitcode_str(int exitcode)
+{
+    switch (exitcode)
+    {
+    case EXITCODE_SUCCESS:      return "ok";
+    case EXITCODE_INVALIDARG:   return "invalid argument";
+    case EXITCODE_NOINPUT:      return "no input";
+    case EXITCODE_CANTOPENFILE: return "cannot open file";
+    case EXITCODE_FAILPROCESS:  return "failed";
+    default:                    return "unknown error";
+    }
+}
+
+// Sets up the macros of the options into a snapshot
+bool prepare_snapshot(const OPTIONS& options, WaveSnapshot& snapshot)
+{
+    const char *empty = "";
+    WaveContext context(empty, empty, "<batch>");
+    if (!setup_context(context, options.argc, options.argv, options.language))
+        return false;
+
+    snapshot.save(context);
+    return true;
+}
+
+// Loads the snapshot file if specified and valid, or sets up the macros
+bool load_or_prepare_snapshot(const OPTIONS& options, WaveSnapshot& snapshot,
+                              std::ostream& err)
+{
+    if (!options.snapshot_file.empty() &&
+        load_snapshot_file(options, snapshot, err))
+    {
+        return true;
+    }
+    return prepare_snapshot(options, snapshot);
+}
+
+// WarmSnapshots --- the snapshots kept between the runs of the server,
+// keyed by the options which affect the macros
+class WarmSnapshots : private boost::noncopyable
+{
+public:
+    static WarmSnapshots& instance()
+    {
+        static WarmSnapshots s_snapshots;
+        return s_snapshots;
+    }
+
+    // Returns NULL on failure
+    const WaveSnapshot *get(const OPTIONS& options)
+    {
+        std::string key = options.language;
+        for (int i = 1; i < options.argc; ++i)
+        {
+            const char *arg = options.argv[i];
+            if (arg[0] == '-' && (arg[1] == 'D' || arg[1] == 'U'))
+            {
+                key += '\n';
+                key += arg;
+            }
+        }
+
+        boost::shared_ptr<WaveSnapshot>& snapshot = m_snapshots[key];
+        if (!snapshot)
+        {
+            boost::shared_ptr<WaveSnapshot> new_snapshot(new WaveSnapshot);
+            if (!prepare_snapshot(options, *new_snapshot))
+                return NULL;
+            snapshot = new_snapshot;
+        }
+        return snapshot.get();
+    }
+
+protected:
+    std::map<std::string, boost::shared_ptr<WaveSnapshot> > m_snapshots;
+
+    WarmSnapshots()
+    {
+    }
+};
+
+// TaskPool --- runs numbered tasks on worker threads.
+// Every worker has its own queue; an idle worker steals from the others.
+class TaskPool : private boost::noncopyable
+{
+public:
+    typedef boost::function<void (size_t worker, size_t task)> task_function;
+
+    explicit TaskPool(size_t num_workers)
+        : m_queues(new QUEUE[num_workers]), m_num_queues(num_workers)
+    {
+    }
+
+    // The tasks are started in the given order. Waits for all of them.
+    void run(const std::vector<size_t>& tasks, task_function fn)
+    {
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            m_queues[i % m_num_queues].tasks.push_back(tasks[i]);
+        }
+
+        if (m_num_queues == 1)
+        {
+            work(0, fn);
+            return;
+        }
+
+        boost::thread_group threads;
+        for (size_t i = 0; i < m_num_queues; ++i)
+        {
+            threads.create_thread(boost::bind(&TaskPool::work, this, i, fn));
+        }
+        threads.join_all();
+    }
+
+protected:
+    struct QUEUE
+    {
+        boost::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+    boost::scoped_array<QUEUE> m_queues;
+    size_t m_num_queues;
+
+    bool pop(size_t index, size_t& task)
+    {
+        QUEUE& queue = m_queues[index];
+        boost::mutex::scoped_lock lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t thief, size_t& task)
+    {
+        for (size_t i = 1; i < m_num_queues; ++i)
+        {
+            QUEUE& queue = m_queues[(thief + i) % m_num_queues];
+            boost::mutex::scoped_lock lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t index, task_function fn)
+    {
+        size_t task;
+        while (pop(index, task) || steal(index, task))
+        {
+            fn(index, task);
+        }
+    }
+};
+
+// BatchWorker --- preprocesses the jobs of a batch.
+// The tokens of Wave are not thread-safe, so every worker thread prepares
+// its own snapshot of the macros.
+class BatchWorker
+{
+public:
+    BatchWorker(const OPTIONS& options, const std::vector<JOB>& jobs,
+                size_t num_workers)
+        : m_options(options), m_jobs(jobs), m_results(jobs.size()),
+          m_messages(jobs.size()), m_snapshots(num_workers)
+    {
+    }
+
+    // Called on the main thread first, to check the options once
+    bool prepare()
+    {
+        m_snapshots[0].reset(new WaveSnapshot);
+        return load_or_prepare_snapshot(m_options, *m_snapshots[0], std::cerr);
+    }
+
+    void operator()(size_t worker, size_t task)
+    {
+        std::ostringstream err;
+        if (!m_snapshots[worker])
+        {
+            // The warnings have been shown by prepare()
+            std::ostringstream ignored;
+            m_snapshots[worker].reset(new WaveSnapshot);
+            load_or_prepare_snapshot(m_options, *m_snapshots[worker], ignored);
+        }
+
+        m_results[task] = preprocess(m_options, m_jobs[task], err,
+                                     m_snapshots[worker].get());
+        m_messages[task] = err.str();
+    }
+
+    int result(size_t task) const
+    {
+        return m_results[task];
+    }
+    const std::string& message(size_t task) const
+    {
+        return m_messages[task];
+    }
+
+protected:
+    const OPTIONS& m_options;
+    const std::vector<JOB>& m_jobs;
+    std::vector<int> m_results;
+    std::vector<std::string> m_messages;
+    std::vector<boost::shared_ptr<WaveSnapshot> > m_snapshots;
+};
+
+// Larger files first, so that a huge file doesn't start last
+struct LargerFirst
+{
+    const std::vector<unsigned long long>& sizes;
+
+    explicit LargerFirst(const std::vector<unsigned long long>& sizes_)
+        : sizes(sizes_)
+    {
+    }
+
+    bool operator()(size_t a, size_t b) const
+    {
+        return sizes[a] > sizes[b];
+    }
+};
+
+// Preprocesses the jobs, sharing the setup work.
+// The outputs don't depend on the number of the worker threads.
+int preprocess_batch(const OPTIONS& options, std::vector<JOB>& jobs)
+{
+    std::vector<unsigned long long> sizes(jobs.size());
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        JOB& job = jobs[i];
+        if (job.output_file.empty() && !options.macros_only &&
+            !options.dependencies_only)
+        {
+            job.output_file = job.input_file + ".i";
+        }
+        if (job.macro_output_file.empty() && options.emit_definitions)
+            job.macro_output_file = job.input_file + ".macros";
+        if (options.emit_dependencies)
+            job.dependency_file = get_dependency_file(job);
+
+        boost::system::error_code ec;
+        sizes[i] = boost::filesystem::file_size(job.input_file, ec);
+        if (ec)
+            sizes[i] = 0;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), LargerFirst(sizes));
+
+    size_t num_workers = options.jobs;
+    if (num_workers == 0)
+        num_workers = boost::thread::hardware_concurrency();
+    if (num_workers == 0)
+        num_workers = 1;
+    if (num_workers > jobs.size())
+        num_workers = jobs.size();
+
+    // Prepare the macros once per worker
+    BatchWorker worker(options, jobs, num_workers);
+    if (!worker.prepare())
+        return EXITCODE_INVALIDARG;
+
+    TaskPool pool(num_workers);
+    pool.run(order, boost::ref(worker));
+
+    // Print messages and summary in the order of jobs
+    size_t failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        std::cerr << worker.message(i);
+    }
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        if (worker.result(i) == EXITCODE_SUCCESS)
+        {
+            std::cerr << "  ok    " << jobs[i].input_file << " -> " <<
+                         (options.dependencies_only ? jobs[i].dependency_file :
+                          options.macros_only ? jobs[i].macro_output_file
+                                              : jobs[i].output_file) << "\n";
+        }
+        else
+        {
+            std::cerr << "  FAIL  " << jobs[i].input_file << " (" <<
+                         get_exitcode_str(worker.result(i)) << ")\n";
+            ++failed;
+        }
+    }
+    std::cerr << jobs.size() << " files, " << failed << " failed\n";
+
+    return failed ? EXITCODE_FAILPROCESS : EXITCODE_SUCCESS;
+}
+
+// Parses a size like "100", "64K", "256M" or "1G"
+bool parse_size(const char *str, unsigned long long& size)
+{
+    char *end;
+    size = strtoull(str, &end, 10);
+    if (end == str)
+        return false;
+
+    switch (*end)
+    {
+    case 'G': case 'g': size *= 1024;   // fall through
+    case 'M': case 'm': size *= 1024;   // fall through
+    case 'K': case 'k': size *= 1024; ++end; break;
+    }
+    return *end == 0;
+}
+
+// Runs mzcpp with the command line
+int run(int argc, char **argv, bool warm)
+{
+    if (argc < 2)
+    {
+        show_help();
+        return EXITCODE_INVALIDARG;
+    }
+
+    std::string arg1 = argv[1];
+    if (arg1 == "--help")
+    {
+        show_help();
+        return EXITCODE_SUCCESS;
+    }
+    if (arg1 == "--version")
+    {
+        show_version();
+        return EXITCODE_SUCCESS;
+    }
+
+    // The files may have been created or removed since the last request
+    IncludeResolver::instance().validate();
+    IncludeDatabase::instance().clear();
+    OutputCache::instance().reset();
+
+    OPTIONS options;
+    options.argc = argc;
+    options.argv = argv;
+    options.emit_definitions = false;
+    options.emit_stats = false;
+    options.jobs = 1;
+    options.warm = warm;
+    options.output_thread = false;
+    options.expansion_cache = true;
+    options.time_report = false;
+    options.macro_profile = false;
+    options.include_graph = false;
+    options.macros_only = false;
+    options.dependencies_only = false;
+    options.emit_dependencies = false;
+    options.cache_size = 256 * 1024 * 1024;
+
+    std::vector<JOB> jobs;
+    std::string output_file, macro_output_file, dependency_file, batch_file;
+    bool cache_stats = false, cache_clear = false, time_report_text = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg[0] != '-')
+        {
+            JOB job;
+            job.input_file = arg;
+            jobs.push_back(job);
+        }
+        else if (arg == "-o")
+        {
+            if (i + 1 < argc)
+            {
+                output_file = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '-o'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg == "-oM")
+        {
+            if (i + 1 < argc)
+            {
+                macro_output_file = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '-oM'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg == "-MF" || arg == "-MT")
+        {
+            if (i + 1 < argc)
+            {
+                if (arg == "-MF")
+                    dependency_file = argv[i + 1];
+                else
+                    options.dependency_target = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '" << arg << "'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg == "-x")
+        {
+            if (i + 1 < argc)
+            {
+                std::string& language = options.language;
+                language = argv[i + 1];
+                _strlwr(&language[0]);
+                if (language != "c" && language != "c++" && language != "rc")
+                {
+                    std::cerr << "ERROR: Invalid argument '" << language <<
+                                 "' specified for '-x'\n";
+                    return EXITCODE_INVALIDARG;
+                }
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '-x'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg == "--batch")
+        {
+            if (i + 1 < argc)
+            {
+                batch_file = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '--batch'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg.compare(0, 2, "-j") == 0)
+        {
+            std::string value = arg.substr(2);
+            if (value.empty() && i + 1 < argc)
+            {
+                value = argv[i + 1];
+                ++i;
+            }
+            if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+            {
+                std::cerr << "ERROR: Invalid argument '" << value <<
+                             "' specified for '-j'\n";
+                return EXITCODE_INVALIDARG;
+            }
+            options.jobs = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg == "--snapshot" || arg == "--snapshot-save" ||
+                 arg == "--include-db" || arg == "--cache" || arg == "--incremental")
+        {
+            if (i + 1 < argc)
+            {
+                if (arg == "--snapshot")
+                    options.snapshot_file = argv[i + 1];
+                else if (arg == "--snapshot-save")
+                    options.save_snapshot_file = argv[i + 1];
+                else if (arg == "--include-db")
+                    options.include_db_file = argv[i + 1];
+                else if (arg == "--incremental")
+                    options.incremental_file = argv[i + 1];
+                else
+                    options.cache_dir = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "ERROR: No argument specified for '" << arg << "'\n";
+                return EXITCODE_INVALIDARG;
+            }
+        }
+        else if (arg == "--cache-size")
+        {
+            if (i + 1 >= argc || !parse_size(argv[i + 1], options.cache_size))
+            {
+                std::cerr << "ERROR: Invalid argument specified for '--cache-size'\n";
+                return EXITCODE_INVALIDARG;
+            }
+            ++i;
+        }
+        else if (arg == "--cache-stats")
+        {
+            cache_stats = true;
+        }
+        else if (arg == "--cache-clear")
+        {
+            cache_clear = true;
+        }
+        else if (arg == "-dM")
+        {
+            options.emit_definitions = true;
+        }
+        else if (arg == "--stats")
+        {
+            options.emit_stats = true;
+        }
+        else if (arg == "--output-thread")
+        {
+            options.output_thread = true;
+        }
+        else if (arg == "--no-expansion-cache")
+        {
+            options.expansion_cache = false;
+        }
+        else if (arg == "--time-report")
+        {
+            options.time_report = time_report_text = true;
+        }
+        else if (arg == "--time-report-json" || arg == "--macro-profile" ||
+                 arg == "--macro-stacks" || arg == "--include-graph" ||
+                 arg == "--include-graph-dot")
+        {
+            if (i + 1 < argc)
             {
-                language = argv[i + 1];
-                _strlwr(&language[0]);
-                if (language != "c" && language != "c++" && language != "rc")
-                {
-                    std::cerr << "ERROR: Invalid argument '" << language <<
-                                 "' specified for '-x'\n";
-                    return EXITCODE_INVALIDARG;
-                }
+                if (arg == "--time-report-json")
+                    options.time_report_file = argv[i + 1];
+                else if (arg == "--macro-profile")
+                    options.macro_profile_file = argv[i + 1];
+                else if (arg == "--macro-stacks")
+                    options.macro_stacks_file = argv[i + 1];
+                else if (arg == "--include-graph")
+                    options.include_graph_file = argv[i + 1];
+                else
+                    options.include_dot_file = argv[i + 1];
                 ++i;
             }
             else
             {
-                std::cerr << "ERROR: No argument specified for '-x'\n";
+                std::cerr << "ERROR: No argument specified for '" << arg << "'\n";
                 return EXITCODE_INVALIDARG;
             }
         }
-        else if (arg == "-dM")
+        else if (arg == "--macros-only")
+        {
+            options.emit_definitions = true;
+            options.macros_only = true;
+        }
+        else if (arg == "-M")
+        {
+            options.dependencies_only = true;
+            options.emit_dependencies = true;
+        }
+        else if (arg == "-MD")
         {
-            emit_definitions = true;
+            options.emit_dependencies = true;
         }
         else if (arg == "-E")
         {
@@ -412,75 +7699,611 @@ int main(int argc, char **argv)
         }
     }
 
-    if (input_file.empty())
+    if (!options.time_report_file.empty())
+        options.time_report = true;
+    options.macro_profile = !options.macro_profile_file.empty() ||
+                            !options.macro_stacks_file.empty();
+    options.include_graph = !options.include_graph_file.empty() ||
+                            !options.include_dot_file.empty();
+
+    // The time report covers the runs from here
+    if (options.time_report)
+        TimeReport::instance().start();
+    if (options.macro_profile)
+        MacroProfile::instance().start();
+    if (options.include_graph)
+        IncludeGraph::instance().start();
+
+    if (!batch_file.empty() && !load_batch_list(batch_file, jobs))
+    {
+        std::cerr << "ERROR: cannot open file '" << batch_file << "'\n";
+        return EXITCODE_CANTOPENFILE;
+    }
+
+    if (!options.cache_dir.empty())
+        OutputCache::instance().open(options.cache_dir, options.cache_size);
+    if (cache_stats || cache_clear)
+    {
+        if (options.cache_dir.empty())
+        {
+            std::cerr << "ERROR: '--cache' is needed for '" <<
+                         (cache_stats ? "--cache-stats" : "--cache-clear") << "'\n";
+            return EXITCODE_INVALIDARG;
+        }
+        if (cache_clear && !OutputCache::instance().clear())
+        {
+            std::cerr << "ERROR: cannot clear cache '" << options.cache_dir << "'\n";
+            return EXITCODE_CANTOPENFILE;
+        }
+        if (cache_stats)
+            OutputCache::instance().print_total_stats(std::cout);
+        if (jobs.empty())
+            return EXITCODE_SUCCESS;
+    }
+
+    if (jobs.empty())
     {
         std::cerr << "ERROR: No input file\n";
         return EXITCODE_NOINPUT;
     }
 
-    // Load source
-    std::ifstream fin(input_file);
-    fin.unsetf(std::ios::skipws);
-    std::string code(std::istreambuf_iterator<char>(fin.rdbuf()),
-                     std::istreambuf_iterator<char>());
-    code += '\n';   // avoid errors
+    if (!options.save_snapshot_file.empty() &&
+        (!options.snapshot_file.empty() || jobs.size() > 1 || !batch_file.empty()))
+    {
+        std::cerr << "ERROR: '--snapshot-save' needs a single input file without '--snapshot'\n";
+        return EXITCODE_INVALIDARG;
+    }
+    if (!options.save_snapshot_file.empty() && options.macros_only)
+    {
+        std::cerr << "ERROR: '--snapshot-save' cannot be used with '--macros-only'\n";
+        return EXITCODE_INVALIDARG;
+    }
+    if (!options.incremental_file.empty() &&
+        (jobs.size() > 1 || !batch_file.empty() || options.macros_only ||
+         !options.snapshot_file.empty() || !options.save_snapshot_file.empty()))
+    {
+        std::cerr << "ERROR: '--incremental' needs a single input file without "
+                     "'--macros-only' and snapshots\n";
+        return EXITCODE_INVALIDARG;
+    }
+    if (options.dependencies_only &&
+        (options.macros_only || !options.save_snapshot_file.empty()))
+    {
+        std::cerr << "ERROR: '-M' cannot be used with '--macros-only' and '--snapshot-save'\n";
+        return EXITCODE_INVALIDARG;
+    }
+    if (options.emit_dependencies && !options.incremental_file.empty())
+    {
+        // A resumed run doesn't see the headers before the checkpoint
+        std::cerr << "ERROR: '-M' and '-MD' cannot be used with '--incremental'\n";
+        return EXITCODE_INVALIDARG;
+    }
+    if (!dependency_file.empty() && !options.emit_dependencies)
+    {
+        std::cerr << "ERROR: '-MF' needs '-M' or '-MD'\n";
+        return EXITCODE_INVALIDARG;
+    }
 
-    // Prepare context
-    WaveContext context(code.begin(), code.end(), input_file.c_str());
+    if (!options.include_db_file.empty())
+        IncludeDatabase::instance().load(options.include_db_file, std::cerr);
 
-    if (!setup_context(context, argc, argv, language))
-        return EXITCODE_INVALIDARG;
+    int ret;
+    if (jobs.size() == 1 && batch_file.empty())
+    {
+        jobs[0].output_file = output_file;
+        jobs[0].macro_output_file = macro_output_file;
+        if (options.dependencies_only)
+        {
+            // -M writes the dependencies instead of the output, as gcc does
+            jobs[0].dependency_file =
+                dependency_file.empty() ? output_file : dependency_file;
+        }
+        else if (options.emit_dependencies)
+        {
+            jobs[0].dependency_file =
+                dependency_file.empty() ? get_dependency_file(jobs[0]) : dependency_file;
+        }
+        const WaveSnapshot *snapshot = NULL;
+        WaveSnapshot file_snapshot;
+        if (!options.snapshot_file.empty() &&
+            load_snapshot_file(options, file_snapshot, std::cerr))
+        {
+            snapshot = &file_snapshot;
+        }
+        else if (options.warm)
+        {
+            snapshot = WarmSnapshots::instance().get(options);
+        }
+        ret = preprocess(options, jobs[0], std::cerr, snapshot);
+    }
+    else
+    {
+        if (!output_file.empty() || !macro_output_file.empty() ||
+            !dependency_file.empty())
+        {
+            std::cerr << "ERROR: '-o', '-oM' and '-MF' cannot be used for multiple input files\n";
+            return EXITCODE_INVALIDARG;
+        }
+        ret = preprocess_batch(options, jobs);
+    }
 
-    try
+    if (!options.include_db_file.empty() &&
+        !IncludeDatabase::instance().save(options.include_db_file))
+    {
+        std::cerr << "WARNING: cannot save include database '" <<
+                     options.include_db_file << "'\n";
+    }
+    OutputCache::instance().close();
+
+    if (options.emit_stats)
+    {
+        print_stats(std::cerr);
+        if (OutputCache::instance().enabled())
+            OutputCache::instance().print_stats(std::cerr);
+    }
+
+    if (time_report_text)
+        TimeReport::instance().print(std::cerr);
+    if (options.time_report_file == "-")
     {
-        if (output_file.empty())
+        TimeReport::instance().print_json(std::cerr);
+    }
+    else if (!options.time_report_file.empty())
+    {
+        std::ofstream fout(options.time_report_file.c_str());
+        TimeReport::instance().print_json(fout);
+        if (!fout.good())
         {
-            WaveContext::iterator_type it, end = context.end();
-            for (it = context.begin(); it != end; ++it)
-            {
-                std::cout << it->get_value();
-            }
+            std::cerr << "WARNING: cannot write time report '" <<
+                         options.time_report_file << "'\n";
         }
-        else
+    }
+    if (!options.macro_profile_file.empty())
+    {
+        std::ofstream fout(options.macro_profile_file.c_str());
+        MacroProfile::instance().print(fout);
+        if (!fout.good())
         {
-            std::ofstream fout(output_file);
-            if (!fout.is_open())
-            {
-                std::cerr << "ERROR: cannot open file '" << output_file << "'\n";
-                return EXITCODE_CANTOPENFILE;
-            }
+            std::cerr << "WARNING: cannot write macro profile '" <<
+                         options.macro_profile_file << "'\n";
+        }
+    }
+    if (!options.macro_stacks_file.empty())
+    {
+        std::ofstream fout(options.macro_stacks_file.c_str());
+        MacroProfile::instance().print_stacks(fout);
+        if (!fout.good())
+        {
+            std::cerr << "WARNING: cannot write macro stacks '" <<
+                         options.macro_stacks_file << "'\n";
+        }
+    }
+    if (!options.include_graph_file.empty())
+    {
+        std::ofstream fout(options.include_graph_file.c_str());
+        IncludeGraph::instance().print_json(fout);
+        if (!fout.good())
+        {
+            std::cerr << "WARNING: cannot write include graph '" <<
+                         options.include_graph_file << "'\n";
+        }
+    }
+    if (!options.include_dot_file.empty())
+    {
+        std::ofstream fout(options.include_dot_file.c_str());
+        IncludeGraph::instance().print_dot(fout);
+        if (!fout.good())
+        {
+            std::cerr << "WARNING: cannot write include graph '" <<
+                         options.include_dot_file << "'\n";
+        }
+    }
 
-            WaveContext::iterator_type it, end = context.end();
-            for (it = context.begin(); it != end; ++it)
+    return ret;
+}
+
+#ifndef _WIN32
+// The protocol between the client and the server:
+//   request:  "MZC1", u32 num_env, u32 num_args, cwd, env..., args...
+//             where a string is u32 length and the bytes
+//   response: frames of u8 type, u32 length and the data, where the type is
+//             'o' (stdout), 'e' (stderr) or 'x' (the exit code, last)
+
+// The environment variables which affect the preprocessing
+static const char * const s_server_env[] =
+{
+    "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH"
+};
+
+bool send_all(int fd, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+    while (size > 0)
+    {
+        ssize_t n = send(fd, p, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void *data, size_t size)
+{
+    char *p = (char *)data;
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool send_u32(int fd, unsigned int value)
+{
+    unsigned char buf[4];
+    buf[0] = (unsigned char)value;
+    buf[1] = (unsigned char)(value >> 8);
+    buf[2] = (unsigned char)(value >> 16);
+    buf[3] = (unsigned char)(value >> 24);
+    return send_all(fd, buf, 4);
+}
+
+bool recv_u32(int fd, unsigned int& value)
+{
+    unsigned char buf[4];
+    if (!recv_all(fd, buf, 4))
+        return false;
+    value = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+    return true;
+}
+
+bool send_string(int fd, const std::string& str)
+{
+    return send_u32(fd, (unsigned int)str.size()) &&
+           send_all(fd, str.data(), str.size());
+}
+
+bool recv_string(int fd, std::string& str)
+{
+    unsigned int size;
+    if (!recv_u32(fd, size) || size > 0x1000000)
+        return false;
+    str.resize(size);
+    return size == 0 || recv_all(fd, &str[0], size);
+}
+
+bool send_frame(int fd, char type, const char *data, size_t size)
+{
+    return send_all(fd, &type, 1) && send_u32(fd, (unsigned int)size) &&
+           send_all(fd, data, size);
+}
+
+// FrameStreamBuf --- sends the written text to the client as frames
+class FrameStreamBuf : public std::streambuf
+{
+public:
+    FrameStreamBuf(int fd, char type) : m_fd(fd), m_type(type), m_ok(true)
+    {
+        setp(m_buf, m_buf + sizeof(m_buf));
+    }
+
+    ~FrameStreamBuf()
+    {
+        sync();
+    }
+
+protected:
+    int m_fd;
+    char m_type;
+    bool m_ok;
+    char m_buf[64 * 1024];
+
+    virtual int_type overflow(int_type ch)
+    {
+        if (sync() != 0)
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    virtual int sync()
+    {
+        size_t size = pptr() - pbase();
+        if (size > 0 && m_ok)
+            m_ok = send_frame(m_fd, m_type, pbase(), size);
+        setp(m_buf, m_buf + sizeof(m_buf));
+        return m_ok ? 0 : -1;
+    }
+};
+
+int connect_server(const char *socket_path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Forwards the arguments to the server. Returns false if it cannot connect.
+bool run_client(const char *socket_path, int argc, char **argv, int& ret)
+{
+    int fd = connect_server(socket_path);
+    if (fd < 0)
+        return false;
+
+    std::vector<std::string> env;
+    for (size_t i = 0; i < sizeof(s_server_env) / sizeof(s_server_env[0]); ++i)
+    {
+        const char *value = getenv(s_server_env[i]);
+        if (value)
+            env.push_back(std::string(s_server_env[i]) + "=" + value);
+    }
+
+    boost::system::error_code ec;
+    std::string cwd = boost::filesystem::current_path(ec).string();
+
+    bool ok = send_all(fd, "MZC1", 4) &&
+              send_u32(fd, (unsigned int)env.size()) &&
+              send_u32(fd, (unsigned int)argc) &&
+              send_string(fd, cwd);
+    for (size_t i = 0; ok && i < env.size(); ++i)
+        ok = send_string(fd, env[i]);
+    for (int i = 0; ok && i < argc; ++i)
+        ok = send_string(fd, argv[i]);
+
+    // Receive the frames
+    ret = EXITCODE_FAILPROCESS;
+    bool done = false;
+    std::vector<char> data;
+    while (ok && !done)
+    {
+        char type;
+        unsigned int size;
+        if (!recv_all(fd, &type, 1) || !recv_u32(fd, size))
+            break;
+        data.resize(size + 1);
+        if (size > 0 && !recv_all(fd, &data[0], size))
+            break;
+
+        switch (type)
+        {
+        case 'o':
+            fwrite(&data[0], 1, size, stdout);
+            break;
+        case 'e':
+            fwrite(&data[0], 1, size, stderr);
+            break;
+        case 'x':
+            if (size == 4)
             {
-                fout << it->get_value();
+                ret = (unsigned char)data[0] | ((unsigned char)data[1] << 8);
+                done = true;
             }
+            break;
         }
+    }
+    fflush(stdout);
+    close(fd);
+
+    if (!done)
+        std::cerr << "ERROR: lost the connection to the server\n";
+    return true;
+}
+
+static volatile sig_atomic_t s_server_quit = 0;
+
+static void server_signal_handler(int)
+{
+    s_server_quit = 1;
+}
+
+void serve_request(int fd)
+{
+    char magic[4];
+    unsigned int num_env, num_args;
+    std::string cwd;
+    if (!recv_all(fd, magic, 4) || memcmp(magic, "MZC1", 4) != 0 ||
+        !recv_u32(fd, num_env) || !recv_u32(fd, num_args) ||
+        num_env > 64 || num_args > 0x10000 || !recv_string(fd, cwd))
+    {
+        return;
+    }
+
+    std::vector<std::string> env(num_env), args(num_args + 1);
+    for (unsigned int i = 0; i < num_env; ++i)
+    {
+        if (!recv_string(fd, env[i]))
+            return;
+    }
+    args[0] = "mzcpp";
+    for (unsigned int i = 1; i <= num_args; ++i)
+    {
+        if (!recv_string(fd, args[i]))
+            return;
+    }
 
-        if (emit_definitions)
+    // The environment of the client
+    for (size_t i = 0; i < sizeof(s_server_env) / sizeof(s_server_env[0]); ++i)
+    {
+        unsetenv(s_server_env[i]);
+    }
+    for (size_t i = 0; i < env.size(); ++i)
+    {
+        size_t k = env[i].find('=');
+        if (k != std::string::npos)
+            setenv(env[i].substr(0, k).c_str(), env[i].c_str() + k + 1, 1);
+    }
+
+    std::vector<char *> argv(args.size() + 1);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = &args[i][0];
+    }
+    argv[args.size()] = NULL;
+
+    int ret;
+    {
+        FrameStreamBuf out(fd, 'o'), err(fd, 'e');
+        std::streambuf *old_out = std::cout.rdbuf(&out);
+        std::streambuf *old_err = std::cerr.rdbuf(&err);
+        if (chdir(cwd.c_str()) != 0)
+        {
+            std::cerr << "ERROR: cannot change directory to '" << cwd << "'\n";
+            ret = EXITCODE_INVALIDARG;
+        }
+        else
         {
-            if (macro_output_file.empty())
+            try
             {
-                print_definitions(context, std::cout);
+                ret = run((int)args.size(), &argv[0], true);
             }
-            else
+            catch (const std::exception& ex)
             {
-                std::ofstream fout(macro_output_file);
-                if (!fout.is_open())
-                {
-                    std::cerr << "ERROR: cannot open file '" << macro_output_file << "'\n";
-                    return EXITCODE_CANTOPENFILE;
-                }
-                print_definitions(context, fout);
+                std::cerr << "ERROR: " << ex.what() << "\n";
+                ret = EXITCODE_FAILPROCESS;
             }
         }
+        std::cout.flush();
+        std::cerr.flush();
+        std::cout.rdbuf(old_out);
+        std::cerr.rdbuf(old_err);
     }
-    catch (const boost::wave::cpp_exception& ex)
+
+    char code[4] = { (char)ret, (char)(ret >> 8), 0, 0 };
+    send_frame(fd, 'x', code, 4);
+}
+
+// Serves the requests of the clients one by one, keeping the caches warm
+int run_server(const char *socket_path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
     {
-        std::cerr << ex.file_name() << ":" << ex.line_no() << ": " <<
-                     ex.description() << std::endl;
+        std::cerr << "ERROR: socket path too long '" << socket_path << "'\n";
+        return EXITCODE_INVALIDARG;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "ERROR: cannot create socket\n";
+        return EXITCODE_FAILPROCESS;
+    }
+
+    // A socket of a dead server is replaced
+    int other = connect_server(socket_path);
+    if (other >= 0)
+    {
+        close(other);
+        close(fd);
+        std::cerr << "ERROR: server already running on '" << socket_path << "'\n";
         return EXITCODE_FAILPROCESS;
     }
+    unlink(socket_path);
 
+    // The clients run as the server, so only the user may connect.
+    // The socket should also be in a private directory.
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || chmod(socket_path, 0600) != 0 || listen(fd, 64) != 0)
+    {
+        close(fd);
+        std::cerr << "ERROR: cannot listen on '" << socket_path << "'\n";
+        return EXITCODE_FAILPROCESS;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!s_server_quit)
+    {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        serve_request(client);
+        close(client);
+    }
+
+    close(fd);
+    unlink(socket_path);
     return EXITCODE_SUCCESS;
 }
+#endif  // ndef _WIN32
+
+int main(int argc, char **argv)
+{
+    std::string arg1 = (argc >= 2) ? argv[1] : "";
+    if (arg1 == "--server" || arg1 == "--client")
+    {
+        if (argc < 3)
+        {
+            std::cerr << "ERROR: No argument specified for '" << arg1 << "'\n";
+            return EXITCODE_INVALIDARG;
+        }
+#ifdef _WIN32
+        std::cerr << "ERROR: '" << arg1 << "' is not supported on this platform\n";
+        return EXITCODE_INVALIDARG;
+#else
+        if (arg1 == "--server")
+            return run_server(argv[2]);
+
+        int ret;
+        if (!run_client(argv[2], argc - 3, argv + 3, ret))
+        {
+            std::cerr << "ERROR: cannot connect to '" << argv[2] << "'\n";
+            return EXITCODE_FAILPROCESS;
+        }
+        return ret;
+#endif
+    }
+
+#ifndef _WIN32
+    // Use the server if running
+    const char *server = getenv("MZCPP_SERVER");
+    if (server && *server && argc >= 2)
+    {
+        int ret;
+        if (run_client(server, argc - 1, argv + 1, ret))
+            return ret;
+    }
+#endif
+
+    return run(argc, argv, false);
+}